@@ -1,32 +1,97 @@
 #!/usr/bin/env python
 import os
+import shutil
+import subprocess
 import sys
 
-env = SConscript("submodules/godot-cpp/SConstruct")
-
-# For reference:
-# - CCFLAGS are compilation flags shared between C and C++
-# - CFLAGS are for C-specific compilation flags
-# - CXXFLAGS are for C++-specific compilation flags
-# - CPPFLAGS are for pre-processor flags
-# - CPPDEFINES are for pre-processor defines
-# - LINKFLAGS are for linking flags
-
-# tweak this if you want to use different folders, or more folders, to store your source code in.
-env.Append(CPPPATH=["source/"])
-sources = Glob("source/*.cpp")
-
-if env["platform"] == "macos":
-    library = env.SharedLibrary(
-        "build/bin/msgpack.{}.{}.framework/msgpack.{}.{}".format(
-            env["platform"], env["target"], env["platform"], env["target"]
-        ),
-        source=sources,
-    )
-else:
-    library = env.SharedLibrary(
-        "build/bin/msgpack{}{}".format(env["suffix"], env["SHLIBSUFFIX"]),
-        source=sources,
-    )
-
-Default(library)
+# `scons bench` and `scons fuzz` only build the native tools around the
+# engine-independent codec core, they do not need godot-cpp.
+tool_targets = ["bench", "fuzz"]
+tools_only = len(COMMAND_LINE_TARGETS) > 0 and all(t in tool_targets for t in COMMAND_LINE_TARGETS)
+
+tools_env = Environment(ENV=os.environ, CPPPATH=["source/"], CXXFLAGS=["-std=c++17", "-O2", "-g"])
+
+bench = tools_env.Program("build/bench/msgpack_bench", ["bench/msgpack_bench.cpp"])
+Alias("bench", bench)
+
+fuzz_env = tools_env.Clone(CXX="clang++")
+fuzz_env.Append(CXXFLAGS=["-fsanitize=fuzzer,address,undefined"], LINKFLAGS=["-fsanitize=fuzzer,address,undefined"])
+fuzz = fuzz_env.Program("build/fuzz/msgpack_fuzz", ["fuzz/msgpack_fuzz.cpp"])
+Alias("fuzz", fuzz)
+
+if not tools_only:
+    env = SConscript("submodules/godot-cpp/SConstruct")
+
+    # For reference:
+    # - CCFLAGS are compilation flags shared between C and C++
+    # - CFLAGS are for C-specific compilation flags
+    # - CXXFLAGS are for C++-specific compilation flags
+    # - CPPFLAGS are for pre-processor flags
+    # - CPPDEFINES are for pre-processor defines
+    # - LINKFLAGS are for linking flags
+
+    # tweak this if you want to use different folders, or more folders, to store your source code in.
+    env.Append(CPPPATH=["source/"])
+
+    # Codec counters behind Msgpack.stats_enabled, `msgpack_stats=no` compiles them out.
+    if ARGUMENTS.get("msgpack_stats", "yes") == "yes":
+        env.Append(CPPDEFINES=["MSGPACK_STATS"])
+
+    sources = Glob("source/*.cpp")
+
+    # `fuzz_binding=yes` links the binding decoder fuzz harness into the
+    # extension, see fuzz/msgpack_binding_fuzz.cpp.
+    if ARGUMENTS.get("fuzz_binding", "no") == "yes":
+        env.Append(CPPDEFINES=["MSGPACK_BINDING_FUZZ"])
+        env.Append(CCFLAGS=["-fsanitize=fuzzer-no-link,address,undefined"], LINKFLAGS=["-fsanitize=fuzzer,address,undefined"])
+        sources += ["fuzz/msgpack_binding_fuzz.cpp"]
+
+    # `scons test godot=<path to Godot>` links the binding tests into the
+    # extension and runs them headless, see tests/msgpack_binding_tests.cpp.
+    binding_tests = "test" in COMMAND_LINE_TARGETS
+    if binding_tests:
+        env.Append(CPPDEFINES=["MSGPACK_BINDING_TESTS"])
+        sources += ["tests/msgpack_binding_tests.cpp"]
+
+    if env["platform"] == "macos":
+        library = env.SharedLibrary(
+            "build/bin/msgpack.{}.{}.framework/msgpack.{}.{}".format(
+                env["platform"], env["target"], env["platform"], env["target"]
+            ),
+            source=sources,
+        )
+    else:
+        library = env.SharedLibrary(
+            "build/bin/msgpack{}{}".format(env["suffix"], env["SHLIBSUFFIX"]),
+            source=sources,
+        )
+
+    Default(library)
+
+    if binding_tests:
+        def run_binding_tests(target, source, env):
+            # The project only gets the extension it is about to run.
+            project = Dir("tests/project").abspath
+            library_name = os.path.basename(str(source[0]))
+            os.makedirs(os.path.join(project, "bin"), exist_ok=True)
+            os.makedirs(os.path.join(project, ".godot"), exist_ok=True)
+            shutil.copy(str(source[0]), os.path.join(project, "bin", library_name))
+            with open(os.path.join(project, "msgpack.gdextension"), "w") as f:
+                f.write('[configuration]\n\nentry_symbol = "msgpack_init"\ncompatibility_minimum = "4.1"\n\n')
+                f.write('[libraries]\n\n{} = "res://bin/{}"\n'.format(env["platform"], library_name))
+            with open(os.path.join(project, ".godot", "extension_list.cfg"), "w") as f:
+                f.write("res://msgpack.gdextension\n")
+
+            run = subprocess.run(
+                [ARGUMENTS.get("godot", "godot"), "--headless", "--path", project, "--quit", "--", "--msgpack-test"],
+                stdout=subprocess.PIPE,
+                stderr=subprocess.STDOUT,
+                universal_newlines=True,
+            )
+            print(run.stdout)
+            # Godot also exits cleanly when the extension failed to load.
+            return 0 if run.returncode == 0 and "All tests passed." in run.stdout else 1
+
+        test = env.Command("build/test/msgpack_test.stamp", library, run_binding_tests)
+        AlwaysBuild(test)
+        Alias("test", test)
@@ -0,0 +1,157 @@
+// Native throughput benchmark for the engine-independent codec core.
+//
+// Build with `scons bench`, run build/bench/msgpack_bench [seconds per case].
+// Every case encodes a batch of messages with a given type mix and decodes
+// it again, reporting MB/s of encoded data and messages per second.
+
+#include "msgpack_core.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace msgpack_core;
+
+typedef void (*EncodeFunc)(VectorWriter &writer, int64_t index);
+
+static void _encode_ints(VectorWriter &writer, int64_t index) {
+    write_array_header(writer, 16);
+    for (int64_t i = 0; i < 16; i++) {
+        write_int(writer, (index * 2654435761LL + i * 40503) % 2000000 - 1000000);
+    }
+}
+
+static void _encode_floats(VectorWriter &writer, int64_t index) {
+    write_array_header(writer, 16);
+    for (int64_t i = 0; i < 16; i++) {
+        write_double(writer, double(index) * 0.25 + double(i) / 3.0);
+    }
+}
+
+static void _encode_strings(VectorWriter &writer, int64_t index) {
+    static const char *words[] = { "id", "position", "velocity", "health", "a somewhat longer string value that needs STR_8" };
+    write_array_header(writer, 8);
+    for (int64_t i = 0; i < 8; i++) {
+        const char *word = words[(index + i) % 5];
+        write_str(writer, word, int64_t(strlen(word)));
+    }
+}
+
+static void _encode_messages(VectorWriter &writer, int64_t index) {
+    write_map_header(writer, 5);
+    write_str(writer, "id", 2);
+    write_int(writer, index);
+    write_str(writer, "type", 4);
+    write_str(writer, "move", 4);
+    write_str(writer, "x", 1);
+    write_float(writer, float(index) * 0.5f);
+    write_str(writer, "y", 1);
+    write_float(writer, float(index) * -0.5f);
+    write_str(writer, "flags", 5);
+    write_array_header(writer, 3);
+    write_bool(writer, true);
+    write_nil(writer);
+    write_uint(writer, uint64_t(index) & 0xffff);
+}
+
+static void _encode_binary(VectorWriter &writer, int64_t index) {
+    static uint8_t blob[16384];
+    blob[index % sizeof(blob)] = uint8_t(index);
+    write_bin(writer, blob, sizeof(blob));
+}
+
+// Walks every value like a decoder would, copying string and binary payloads
+// out of the buffer and touching scalars so the work cannot be optimized away.
+static uint64_t _decode_all(const std::vector<uint8_t> &buffer, int64_t &messages) {
+    static std::vector<uint8_t> scratch;
+    BufferReader reader(buffer.data(), int64_t(buffer.size()));
+    Result result;
+    Item item;
+    uint64_t checksum = 0;
+    messages = 0;
+    while (reader.get_available() > 0) {
+        int64_t pending = 1;
+        while (pending > 0) {
+            pending--;
+            if (!read_item(reader, item, result)) {
+                fprintf(stderr, "decode failed at %lld: %s\n", (long long)result.offset, result.message);
+                exit(1);
+            }
+            switch (item.kind) {
+                case KIND_ARRAY:
+                    pending += item.length;
+                    break;
+                case KIND_MAP:
+                    pending += item.length * 2;
+                    break;
+                case KIND_STR:
+                case KIND_BIN:
+                case KIND_EXT:
+                    scratch.assign(item.data, item.data + item.length);
+                    checksum += scratch.empty() ? 0 : scratch[0] + scratch.size();
+                    break;
+                default:
+                    checksum += uint64_t(item.integer) + uint64_t(item.real);
+                    break;
+            }
+        }
+        messages++;
+    }
+    return checksum;
+}
+
+static double _seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void _run(const char *name, EncodeFunc encode, double budget) {
+    const int64_t batch = 1000;
+    VectorWriter writer;
+
+    int64_t rounds = 0;
+    int64_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        writer.buffer.clear();
+        for (int64_t i = 0; i < batch; i++) {
+            encode(writer, rounds * batch + i);
+        }
+        bytes += writer.get_size();
+        rounds++;
+    } while (_seconds_since(start) < budget);
+    double encode_time = _seconds_since(start);
+    double encode_mbs = double(bytes) / encode_time / 1e6;
+    double encode_msgs = double(rounds * batch) / encode_time;
+
+    uint64_t checksum = 0;
+    int64_t decoded = 0;
+    rounds = 0;
+    start = std::chrono::steady_clock::now();
+    do {
+        int64_t messages = 0;
+        checksum += _decode_all(writer.buffer, messages);
+        decoded += messages;
+        rounds++;
+    } while (_seconds_since(start) < budget);
+    double decode_time = _seconds_since(start);
+    double decode_mbs = double(writer.get_size()) * double(rounds) / decode_time / 1e6;
+    double decode_msgs = double(decoded) / decode_time;
+
+    printf("%-10s %8lld B/msg  encode %9.1f MB/s %11.0f msg/s  decode %9.1f MB/s %11.0f msg/s  (%llu)\n",
+            name, (long long)(writer.get_size() / batch), encode_mbs, encode_msgs, decode_mbs, decode_msgs,
+            (unsigned long long)(checksum & 0xff));
+}
+
+int main(int argc, char **argv) {
+    double budget = argc > 1 ? atof(argv[1]) : 0.5;
+    if (budget <= 0.0) {
+        budget = 0.5;
+    }
+    _run("ints", _encode_ints, budget);
+    _run("floats", _encode_floats, budget);
+    _run("strings", _encode_strings, budget);
+    _run("messages", _encode_messages, budget);
+    _run("binary", _encode_binary, budget);
+    return 0;
+}
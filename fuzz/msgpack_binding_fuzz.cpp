@@ -0,0 +1,67 @@
+// Fuzz harness for the binding decoder in Msgpack::_unpack.
+//
+// Variants need a running engine, so this one is linked into the extension
+// instead of a standalone binary. `scons fuzz_binding=yes` builds the
+// extension with it, libFuzzer, AddressSanitizer and
+// UndefinedBehaviorSanitizer. Start Godot with the sanitizer runtime
+// preloaded and pass `-- --msgpack-fuzz` followed by the usual libFuzzer
+// arguments; the fuzzer takes over once the extension is initialized.
+
+#include "msgpack.hpp"
+
+#include <godot_cpp/classes/os.hpp>
+
+#include <cstdlib>
+#include <vector>
+
+using namespace godot;
+
+extern "C" int LLVMFuzzerRunDriver(int *argc, char ***argv, int (*callback)(const uint8_t *data, size_t size));
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // UNPACK_OBJECTS is left out, it would instantiate arbitrary classes.
+    static const uint32_t flag_sets[] = { 0, Msgpack::UNPACK_PACKED_ARRAYS };
+    MsgpackKeyCache key_cache;
+    for (uint32_t flags : flag_sets) {
+        MsgpackReader reader(data, int64_t(size));
+        reader.key_cache = &key_cache;
+        reader.flags = flags;
+        MsgpackError error;
+        Msgpack::_unpack(reader, error);
+        if (reader.depth != 0) {
+            abort();
+        }
+        if (error.failed()) {
+            continue;
+        }
+
+        // A value the binding decodes is well-formed to the core as well.
+        msgpack_core::BufferReader skipper(data, int64_t(size));
+        msgpack_core::Result result;
+        if (!msgpack_core::skip(skipper, result) || skipper.get_position() != reader.get_position()) {
+            abort();
+        }
+    }
+    return 0;
+}
+
+// Called once the extension is initialized, runs the fuzzer and exits when
+// the command line asks for it.
+void msgpack_binding_fuzz_main() {
+    PackedStringArray args = OS::get_singleton()->get_cmdline_user_args();
+    if (args.is_empty() || args[0] != "--msgpack-fuzz") {
+        return;
+    }
+    std::vector<CharString> storage;
+    for (int64_t i = 1; i < args.size(); i++) {
+        storage.push_back(args[i].utf8());
+    }
+    std::vector<char *> argv;
+    argv.push_back((char *)"msgpack_binding_fuzz");
+    for (CharString &arg : storage) {
+        argv.push_back((char *)arg.get_data());
+    }
+    int argc = int(argv.size());
+    char **argv_ptr = argv.data();
+    exit(LLVMFuzzerRunDriver(&argc, &argv_ptr, LLVMFuzzerTestOneInput));
+}
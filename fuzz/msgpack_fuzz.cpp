@@ -0,0 +1,115 @@
+// Fuzz harness for the engine-independent codec core.
+//
+// `scons fuzz` builds it with libFuzzer, AddressSanitizer and
+// UndefinedBehaviorSanitizer. Define MSGPACK_FUZZ_STANDALONE to get a plain
+// main() that replays the files given on the command line instead.
+
+#include "msgpack_core.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace msgpack_core;
+
+// Re-encodes every item read from the source, so that decoding, skipping
+// and encoding are all exercised by the same input.
+static bool _copy_value(BufferReader &reader, VectorWriter &writer, Result &result) {
+    int64_t pending = 1;
+    Item item;
+    while (pending > 0) {
+        pending--;
+        if (!read_item(reader, item, result)) {
+            return false;
+        }
+        switch (item.kind) {
+            case KIND_NIL:
+                write_nil(writer);
+                break;
+            case KIND_BOOL:
+                write_bool(writer, item.boolean);
+                break;
+            case KIND_INT:
+                write_int(writer, item.integer);
+                break;
+            case KIND_UINT:
+                write_uint(writer, uint64_t(item.integer));
+                break;
+            case KIND_FLOAT32:
+                write_float(writer, float(item.real));
+                break;
+            case KIND_FLOAT64:
+                write_double(writer, item.real);
+                break;
+            case KIND_STR:
+                write_str(writer, (const char *)item.data, item.length);
+                break;
+            case KIND_BIN:
+                write_bin(writer, item.data, item.length);
+                break;
+            case KIND_EXT:
+                write_ext_header(writer, item.ext_type, item.length);
+                writer.put_data(item.data, item.length);
+                break;
+            case KIND_ARRAY:
+                write_array_header(writer, item.length);
+                pending += item.length;
+                break;
+            case KIND_MAP:
+                write_map_header(writer, item.length);
+                pending += item.length * 2;
+                break;
+        }
+    }
+    return true;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    BufferReader reader(data, int64_t(size));
+    BufferReader skipper(data, int64_t(size));
+    while (reader.get_available() > 0) {
+        VectorWriter writer;
+        Result result;
+        Result skip_result;
+        bool copied = _copy_value(reader, writer, result);
+        bool skipped = skip(skipper, skip_result);
+        if (copied != skipped) {
+            abort();
+        }
+        if (!copied) {
+            break;
+        }
+        if (reader.get_position() != skipper.get_position()) {
+            abort();
+        }
+
+        // The canonical encoding has to survive another round trip unchanged.
+        BufferReader again(writer.buffer.data(), writer.get_size());
+        VectorWriter copy;
+        if (!_copy_value(again, copy, result) || again.get_available() != 0 || copy.buffer != writer.buffer) {
+            abort();
+        }
+    }
+    return 0;
+}
+
+#ifdef MSGPACK_FUZZ_STANDALONE
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == nullptr) {
+            fprintf(stderr, "cannot open %s\n", argv[i]);
+            return 1;
+        }
+        std::vector<uint8_t> input;
+        uint8_t chunk[4096];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            input.insert(input.end(), chunk, chunk + read);
+        }
+        fclose(file);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    return 0;
+}
+#endif
@@ -1,8 +1,21 @@
 #include "msgpack.hpp"
 
+#include "msgpack_byteswap.hpp"
+#include "msgpack_encoder.hpp"
+#include "msgpack_utf8.hpp"
+
+#include <godot_cpp/classes/class_db_singleton.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/performance.hpp>
+#include <godot_cpp/classes/resource.hpp>
+#include <godot_cpp/classes/resource_loader.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
 #include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
 
+#include <iterator>
+
 using namespace godot;
 
 Msgpack::Msgpack() {
@@ -11,6 +24,16 @@ Msgpack::Msgpack() {
 }
 
 Msgpack::~Msgpack() {
+    for (const KeyValue<int64_t, AsyncTask *> &E : async_tasks) {
+        WorkerThreadPool::get_singleton()->wait_for_task_completion(E.value->pool_task);
+        memdelete(E.value);
+    }
+    async_tasks.clear();
+    _remove_monitors();
+    MsgpackKeyCache::free_thread_caches();
+    MsgpackNameCache::free_thread_caches();
+    MsgpackObjectCache::free_thread_caches();
+
     ERR_FAIL_COND(msgpack != this);
     msgpack = nullptr;
 }
@@ -19,133 +42,683 @@ Msgpack *Msgpack::get_singleton() {
     return msgpack;
 }
 
-PackedByteArray Msgpack::pack(const Variant& data) {
-    StreamPeerBuffer *buffer = memnew(StreamPeerBuffer);
-    buffer->set_big_endian(true);
+PackedByteArray Msgpack::pack(const Variant& data, BitField<PackFlags> flags) {
+    MSGPACK_STATS_BEGIN(sample);
+    MsgpackWriter writer(_estimate_size(data));
+    writer.flags = uint32_t(int64_t(flags));
+    MsgpackError error;
+
+    _pack(data, writer, error);
+    MSGPACK_STATS_END_PACK(sample, writer.get_size(), error.failed());
+    if (error.failed()) {
+        _print_error(error);
+    }
+    return _finish(writer, error);
+}
+
+Variant Msgpack::unpack(const PackedByteArray& data, BitField<UnpackFlags> flags, int64_t max_decompressed_size) {
+    MSGPACK_STATS_BEGIN(sample);
+    MsgpackReader reader(data.ptr(), data.size());
+    reader.key_cache = _get_key_cache();
+    reader.flags = uint32_t(int64_t(flags));
+    MsgpackError error;
+
+    Variant result = _unpack_root(reader, max_decompressed_size, error);
+    MSGPACK_STATS_END_UNPACK(sample, data.size(), error.failed());
+    if (error.failed()) {
+        _print_error(error);
+    }
+    return result;
+}
+
+Dictionary Msgpack::pack_checked(const Variant& data, BitField<PackFlags> flags) {
+    MSGPACK_STATS_BEGIN(sample);
+    MsgpackWriter writer(_estimate_size(data));
+    writer.flags = uint32_t(int64_t(flags));
+    MsgpackError error;
+
+    _pack(data, writer, error);
+    MSGPACK_STATS_END_PACK(sample, writer.get_size(), error.failed());
+    if (error.failed()) {
+        return _make_result(PackedByteArray(), error);
+    }
+    return _make_result(_finish(writer, error), error);
+}
+
+Dictionary Msgpack::unpack_checked(const PackedByteArray& data, BitField<UnpackFlags> flags, int64_t max_decompressed_size) {
+    MSGPACK_STATS_BEGIN(sample);
+    MsgpackReader reader(data.ptr(), data.size());
+    reader.key_cache = _get_key_cache();
+    reader.flags = uint32_t(int64_t(flags));
+    MsgpackError error;
+
+    Variant result = _unpack_root(reader, max_decompressed_size, error);
+    MSGPACK_STATS_END_UNPACK(sample, data.size(), error.failed());
+    return _make_result(result, error);
+}
+
+int64_t Msgpack::pack_into(const Variant& data, const Ref<MsgpackEncoder>& encoder, int64_t offset) {
+    ERR_FAIL_COND_V_MSG(encoder.is_null(), -1, "Encoder is null.");
+    // The encoder's own storage is written, so nothing is copied.
+    MsgpackWriter &writer = encoder->writer;
+    ERR_FAIL_COND_V_MSG(offset < 0 || offset > writer.get_size(), -1, "Offset out of range.");
+    MSGPACK_STATS_BEGIN(sample);
+    writer.truncate(offset);
+    MsgpackError error;
+
+    _pack(data, writer, error);
+    MSGPACK_STATS_END_PACK(sample, writer.get_size() - offset, error.failed());
+    if (error.failed()) {
+        writer.reset_to(offset);
+        _print_error(error);
+        return -1;
+    }
+    return writer.get_size();
+}
+
+Dictionary Msgpack::unpack_from(const PackedByteArray& data, int64_t offset, BitField<UnpackFlags> flags, int64_t max_decompressed_size) {
+    MsgpackError error;
+    if (offset < 0 || offset > data.size()) {
+        error.set(Error::ERR_PARAMETER_RANGE_ERROR, offset, "Offset out of range!");
+        Dictionary res = _make_result(Variant(), error);
+        res["consumed"] = 0;
+        return res;
+    }
+    MSGPACK_STATS_BEGIN(sample);
+    MsgpackReader reader(data.ptr() + offset, data.size() - offset);
+    reader.key_cache = _get_key_cache();
+    reader.flags = uint32_t(int64_t(flags));
+
+    Variant result = _unpack_root(reader, max_decompressed_size, error);
+    MSGPACK_STATS_END_UNPACK(sample, reader.get_position(), error.failed());
+    if (error.failed()) {
+        error.offset += offset;
+    }
+    Dictionary res = _make_result(result, error);
+    res["consumed"] = error.failed() ? 0 : reader.get_position();
+    return res;
+}
+
+TypedArray<PackedByteArray> Msgpack::pack_batch(const Array& data, BitField<PackFlags> flags) {
+    PackBatch batch;
+    batch.flags = uint32_t(int64_t(flags));
+    uint32_t count = data.size();
+    batch.inputs.resize(count);
+    batch.outputs.resize(count);
+    batch.errors.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        batch.inputs[i] = data[i];
+    }
+
+    if (count > 1 && !(batch.flags & PACK_OBJECTS)) {
+        WorkerThreadPool *pool = WorkerThreadPool::get_singleton();
+        int64_t group = pool->add_native_group_task(&Msgpack::_pack_batch_task, &batch, count, -1, true, "Msgpack::pack_batch");
+        pool->wait_for_group_task_completion(group);
+    } else {
+        // Objects are not safe to read from worker threads.
+        for (uint32_t i = 0; i < count; i++) {
+            _pack_batch_task(&batch, i);
+        }
+    }
+
+    TypedArray<PackedByteArray> result;
+    result.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        if (batch.errors[i].failed()) {
+            _print_error(batch.errors[i]);
+        }
+        result[i] = batch.outputs[i];
+    }
+    return result;
+}
 
-    Dictionary error;
-    error["error"] = Error::OK;
-    error["error_message"] = "";
+Array Msgpack::unpack_batch(const TypedArray<PackedByteArray>& data, BitField<UnpackFlags> flags, int64_t max_decompressed_size) {
+    UnpackBatch batch;
+    batch.intern_keys = intern_keys;
+    batch.flags = uint32_t(int64_t(flags)) & ~uint32_t(UNPACK_PARALLEL);
+    batch.max_decompressed_size = max_decompressed_size;
+    uint32_t count = data.size();
+    batch.inputs.resize(count);
+    batch.outputs.resize(count);
+    batch.errors.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        batch.inputs[i] = data[i];
+    }
 
-    _pack(data, buffer, error);
-    PackedByteArray result = buffer->get_data_array();
-    memdelete(buffer);
+    if (count > 1 && !(batch.flags & UNPACK_OBJECTS)) {
+        WorkerThreadPool *pool = WorkerThreadPool::get_singleton();
+        int64_t group = pool->add_native_group_task(&Msgpack::_unpack_batch_task, &batch, count, -1, true, "Msgpack::unpack_batch");
+        pool->wait_for_group_task_completion(group);
+    } else {
+        // Objects are not safe to create on worker threads.
+        for (uint32_t i = 0; i < count; i++) {
+            _unpack_batch_task(&batch, i);
+        }
+    }
 
-    if (int(error["error"]) != Error::OK) {
-        UtilityFunctions::print(error["error_message"]);
+    Array result;
+    result.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        if (batch.errors[i].failed()) {
+            _print_error(batch.errors[i]);
+        }
+        result[i] = batch.outputs[i];
     }
     return result;
 }
 
-Variant Msgpack::unpack(const PackedByteArray& data) {
-    StreamPeerBuffer *buffer = memnew(StreamPeerBuffer);
-    buffer->set_big_endian(true);
-    buffer->set_data_array(data);
+PackedByteArray Msgpack::pack_delta(const Variant& previous, const Variant& current, BitField<PackFlags> flags) {
+    MSGPACK_STATS_BEGIN(sample);
+    MsgpackWriter writer(_estimate_size(current) / 8 + 16);
+    // apply_delta reads patches as they are, it does not decompress.
+    writer.flags = uint32_t(int64_t(flags)) & ~uint32_t(PACK_COMPRESS);
+    MsgpackError error;
 
-    Dictionary error;
-    error["error"] = Error::OK;
-    error["error_message"] = "";
+    _pack_delta(previous, current, writer, error, true);
+    MSGPACK_STATS_END_PACK(sample, writer.get_size(), error.failed());
+    if (error.failed()) {
+        _print_error(error);
+        return PackedByteArray();
+    }
+    return _finish(writer, error);
+}
 
-    Variant result = _unpack(buffer, error);
-    memdelete(buffer);
+Variant Msgpack::apply_delta(const Variant& previous, const PackedByteArray& patch) {
+    MSGPACK_STATS_BEGIN(sample);
+    MsgpackReader reader(patch.ptr(), patch.size());
+    reader.key_cache = _get_key_cache();
+    MsgpackError error;
 
-    if (int(error["error"]) != Error::OK) {
-        UtilityFunctions::print(error["error_message"]);
+    Variant result = _apply_delta(previous, reader, error);
+    MSGPACK_STATS_END_UNPACK(sample, patch.size(), error.failed());
+    if (error.failed()) {
+        _print_error(error);
+        return Variant();
     }
     return result;
 }
 
+PackedByteArray Msgpack::pack_timestamp(double unix_time) {
+    MsgpackWriter writer(15);
+    MsgpackError error;
+
+    _pack_timestamp(writer, unix_time, error);
+    if (error.failed()) {
+        _print_error(error);
+        return PackedByteArray();
+    }
+    return writer.finish();
+}
+
+int64_t Msgpack::pack_async(const Variant& data, const Callable& callback, BitField<PackFlags> flags) {
+    ERR_FAIL_COND_V_MSG((int64_t(flags) & PACK_OBJECTS), -1, "PACK_OBJECTS is not supported by pack_async, objects are only read on the calling thread.");
+    return _start_async(data, false, callback, uint32_t(int64_t(flags)), 0);
+}
+
+int64_t Msgpack::unpack_async(const PackedByteArray& data, const Callable& callback, BitField<UnpackFlags> flags, int64_t max_decompressed_size) {
+    ERR_FAIL_COND_V_MSG((int64_t(flags) & UNPACK_OBJECTS), -1, "UNPACK_OBJECTS is not supported by unpack_async, objects are only created on the calling thread.");
+    return _start_async(data, true, callback, uint32_t(int64_t(flags)) & ~uint32_t(UNPACK_PARALLEL), max_decompressed_size);
+}
+
+bool Msgpack::cancel_async(int64_t task_id) {
+    AsyncTask **task = async_tasks.getptr(task_id);
+    if (task == nullptr) {
+        return false;
+    }
+    (*task)->cancelled.store(true);
+    return true;
+}
+
+void Msgpack::set_intern_keys(bool p_enabled) {
+    intern_keys = p_enabled;
+}
+
+bool Msgpack::is_intern_keys() const {
+    return intern_keys;
+}
+
+void Msgpack::clear_key_cache() {
+    MsgpackKeyCache::clear_thread_caches();
+}
+
+void Msgpack::set_compression_mode(int p_mode) {
+    ERR_FAIL_COND_MSG(p_mode < FileAccess::COMPRESSION_FASTLZ || p_mode > FileAccess::COMPRESSION_GZIP, "Unsupported compression mode.");
+    compression_mode.store(p_mode);
+}
+
+int Msgpack::get_compression_mode() const {
+    return compression_mode.load();
+}
+
+void Msgpack::set_compression_threshold(int64_t p_threshold) {
+    compression_threshold.store(MAX(p_threshold, 0));
+}
+
+int64_t Msgpack::get_compression_threshold() const {
+    return compression_threshold.load();
+}
+
+void Msgpack::set_max_depth(int64_t p_depth) {
+    ERR_FAIL_COND(p_depth < 1);
+    max_depth.store(p_depth);
+}
+
+int64_t Msgpack::get_max_depth() const {
+    return max_depth.load();
+}
+
+void Msgpack::set_stats_enabled(bool p_enabled) {
+#ifdef MSGPACK_STATS
+    stats.enabled.store(p_enabled);
+    if (p_enabled) {
+        _add_monitors();
+    } else {
+        _remove_monitors();
+    }
+#else
+    ERR_FAIL_COND_MSG(p_enabled, "Msgpack was built without MSGPACK_STATS.");
+#endif
+}
+
+bool Msgpack::is_stats_enabled() const {
+    return stats.is_enabled();
+}
+
+Dictionary Msgpack::get_stats() const {
+    return stats.to_dictionary();
+}
+
+void Msgpack::reset_stats() {
+    stats.reset();
+}
+
 void Msgpack::_bind_methods() {
-    ClassDB::bind_method(D_METHOD("pack", "data"), &Msgpack::pack);
-    ClassDB::bind_method(D_METHOD("unpack", "data"), &Msgpack::unpack);
+    ClassDB::bind_method(D_METHOD("pack", "data", "flags"), &Msgpack::pack, DEFVAL(0));
+    ClassDB::bind_method(D_METHOD("unpack", "data", "flags", "max_decompressed_size"), &Msgpack::unpack, DEFVAL(0), DEFVAL(MSGPACK_MAX_DECOMPRESSED_SIZE));
+    ClassDB::bind_method(D_METHOD("pack_checked", "data", "flags"), &Msgpack::pack_checked, DEFVAL(0));
+    ClassDB::bind_method(D_METHOD("unpack_checked", "data", "flags", "max_decompressed_size"), &Msgpack::unpack_checked, DEFVAL(0), DEFVAL(MSGPACK_MAX_DECOMPRESSED_SIZE));
+    ClassDB::bind_method(D_METHOD("pack_into", "data", "encoder", "offset"), &Msgpack::pack_into);
+    ClassDB::bind_method(D_METHOD("unpack_from", "data", "offset", "flags", "max_decompressed_size"), &Msgpack::unpack_from, DEFVAL(0), DEFVAL(MSGPACK_MAX_DECOMPRESSED_SIZE));
+    ClassDB::bind_method(D_METHOD("pack_batch", "data", "flags"), &Msgpack::pack_batch, DEFVAL(0));
+    ClassDB::bind_method(D_METHOD("unpack_batch", "data", "flags", "max_decompressed_size"), &Msgpack::unpack_batch, DEFVAL(0), DEFVAL(MSGPACK_MAX_DECOMPRESSED_SIZE));
+    ClassDB::bind_method(D_METHOD("pack_delta", "previous", "current", "flags"), &Msgpack::pack_delta, DEFVAL(0));
+    ClassDB::bind_method(D_METHOD("apply_delta", "previous", "patch"), &Msgpack::apply_delta);
+    ClassDB::bind_method(D_METHOD("pack_timestamp", "unix_time"), &Msgpack::pack_timestamp);
+    ClassDB::bind_method(D_METHOD("pack_async", "data", "callback", "flags"), &Msgpack::pack_async, DEFVAL(Callable()), DEFVAL(0));
+    ClassDB::bind_method(D_METHOD("unpack_async", "data", "callback", "flags", "max_decompressed_size"), &Msgpack::unpack_async, DEFVAL(Callable()), DEFVAL(0), DEFVAL(MSGPACK_MAX_DECOMPRESSED_SIZE));
+    ClassDB::bind_method(D_METHOD("cancel_async", "task_id"), &Msgpack::cancel_async);
+    ClassDB::bind_method(D_METHOD("_async_finished", "task_id"), &Msgpack::_async_finished);
+    ClassDB::bind_method(D_METHOD("set_intern_keys", "enabled"), &Msgpack::set_intern_keys);
+    ClassDB::bind_method(D_METHOD("is_intern_keys"), &Msgpack::is_intern_keys);
+    ClassDB::bind_method(D_METHOD("clear_key_cache"), &Msgpack::clear_key_cache);
+
+    ClassDB::bind_method(D_METHOD("set_compression_mode", "mode"), &Msgpack::set_compression_mode);
+    ClassDB::bind_method(D_METHOD("get_compression_mode"), &Msgpack::get_compression_mode);
+    ClassDB::bind_method(D_METHOD("set_compression_threshold", "bytes"), &Msgpack::set_compression_threshold);
+    ClassDB::bind_method(D_METHOD("get_compression_threshold"), &Msgpack::get_compression_threshold);
+    ClassDB::bind_method(D_METHOD("set_max_depth", "depth"), &Msgpack::set_max_depth);
+    ClassDB::bind_method(D_METHOD("get_max_depth"), &Msgpack::get_max_depth);
+    ClassDB::bind_method(D_METHOD("set_stats_enabled", "enabled"), &Msgpack::set_stats_enabled);
+    ClassDB::bind_method(D_METHOD("is_stats_enabled"), &Msgpack::is_stats_enabled);
+    ClassDB::bind_method(D_METHOD("get_stats"), &Msgpack::get_stats);
+    ClassDB::bind_method(D_METHOD("reset_stats"), &Msgpack::reset_stats);
+
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "intern_keys"), "set_intern_keys", "is_intern_keys");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "compression_mode", PROPERTY_HINT_ENUM, "FastLZ,Deflate,Zstd,GZip"), "set_compression_mode", "get_compression_mode");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "compression_threshold"), "set_compression_threshold", "get_compression_threshold");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_depth"), "set_max_depth", "get_max_depth");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "stats_enabled"), "set_stats_enabled", "is_stats_enabled");
+
+    BIND_BITFIELD_FLAG(PACK_COMPACT_NUMBERS);
+    BIND_BITFIELD_FLAG(PACK_COMPRESS);
+    BIND_BITFIELD_FLAG(PACK_OBJECTS);
+    BIND_BITFIELD_FLAG(UNPACK_OBJECTS);
+    BIND_BITFIELD_FLAG(UNPACK_PARALLEL);
+    BIND_BITFIELD_FLAG(UNPACK_PACKED_ARRAYS);
+    BIND_BITFIELD_FLAG(UNPACK_DECOMPRESS);
+
+    ADD_SIGNAL(MethodInfo("pack_completed", PropertyInfo(Variant::INT, "task_id"), PropertyInfo(Variant::PACKED_BYTE_ARRAY, "result"), PropertyInfo(Variant::INT, "error")));
+    ADD_SIGNAL(MethodInfo("unpack_completed", PropertyInfo(Variant::INT, "task_id"), PropertyInfo(Variant::NIL, "result"), PropertyInfo(Variant::INT, "error")));
 }
 
 Msgpack *Msgpack::msgpack = nullptr;
+MsgpackStats Msgpack::stats;
+std::atomic<int> Msgpack::compression_mode = { FileAccess::COMPRESSION_ZSTD };
+std::atomic<int64_t> Msgpack::compression_threshold = { 1024 };
+std::atomic<int64_t> Msgpack::max_depth = { MSGPACK_DEFAULT_MAX_DEPTH };
+
+static const char *_monitor_names[] = {
+    "pack_calls",
+    "pack_bytes",
+    "pack_usec",
+    "pack_errors",
+    "unpack_calls",
+    "unpack_bytes",
+    "unpack_usec",
+    "unpack_errors",
+};
+
+void Msgpack::_add_monitors() {
+    Performance *performance = Performance::get_singleton();
+    if (monitors_added || performance == nullptr) {
+        return;
+    }
+    for (int64_t i = 0; i < int64_t(std::size(_monitor_names)); i++) {
+        Array arguments;
+        arguments.push_back(i);
+        performance->add_custom_monitor(String("Msgpack/") + _monitor_names[i], callable_mp(this, &Msgpack::_get_monitor), arguments);
+    }
+    monitors_added = true;
+}
+
+void Msgpack::_remove_monitors() {
+    Performance *performance = Performance::get_singleton();
+    if (!monitors_added || performance == nullptr) {
+        return;
+    }
+    for (const char *name : _monitor_names) {
+        performance->remove_custom_monitor(String("Msgpack/") + name);
+    }
+    monitors_added = false;
+}
+
+Variant Msgpack::_get_monitor(int64_t index) const {
+    // Same order as _monitor_names.
+    const std::atomic<uint64_t> *counters[] = {
+        &stats.pack_calls,
+        &stats.pack_bytes,
+        &stats.pack_usec,
+        &stats.pack_errors,
+        &stats.unpack_calls,
+        &stats.unpack_bytes,
+        &stats.unpack_usec,
+        &stats.unpack_errors,
+    };
+    ERR_FAIL_INDEX_V(index, int64_t(std::size(counters)), 0);
+    return int64_t(counters[index]->load(std::memory_order_relaxed));
+}
+
+PackedByteArray Msgpack::_finish(MsgpackWriter &writer, const MsgpackError &error) {
+    PackedByteArray packed = writer.finish();
+    if ((writer.flags & PACK_COMPRESS) && !error.failed()) {
+        return _compress(packed);
+    }
+    return packed;
+}
+
+PackedByteArray Msgpack::_compress(const PackedByteArray& packed) {
+    int64_t raw_size = packed.size();
+    if (raw_size < compression_threshold.load() || raw_size > MSGPACK_MAX_DECOMPRESSED_SIZE) {
+        return packed;
+    }
+    int mode = compression_mode.load();
+    PackedByteArray compressed = packed.compress(mode);
+    // Header, mode and raw size take at most 11 bytes, keep the raw
+    // value when compressing does not pay for them.
+    if (compressed.is_empty() || compressed.size() + 11 >= raw_size) {
+        return packed;
+    }
+
+    MsgpackWriter writer(compressed.size() + 11);
+    MsgpackError error;
+    _pack_ext_header(writer, MSGPACK_EXT_COMPRESSED, compressed.size() + 5, error);
+    writer.put_u8(uint8_t(mode));
+    writer.put_u32(uint32_t(raw_size));
+    writer.put_data(compressed.ptr(), compressed.size());
+    return writer.finish();
+}
+
+Dictionary Msgpack::_make_result(const Variant& result, const MsgpackError &error) {
+    Dictionary res;
+    res["result"] = result;
+    res["error"] = error.code;
+    res["error_offset"] = error.offset;
+    res["error_message"] = error.failed() ? String(error.message) : String();
+    return res;
+}
+
+void Msgpack::_pack_batch_task(void *userdata, uint32_t index) {
+    PackBatch *batch = (PackBatch *)userdata;
+    const Variant &input = batch->inputs[index];
+
+    MSGPACK_STATS_BEGIN(sample);
+    MsgpackWriter writer(_estimate_size(input));
+    writer.flags = batch->flags;
+    _pack(input, writer, batch->errors[index]);
+    MSGPACK_STATS_END_PACK(sample, writer.get_size(), batch->errors[index].failed());
+    batch->outputs[index] = _finish(writer, batch->errors[index]);
+}
+
+void Msgpack::_unpack_batch_task(void *userdata, uint32_t index) {
+    UnpackBatch *batch = (UnpackBatch *)userdata;
+    const PackedByteArray &input = batch->inputs[index];
+
+    MSGPACK_STATS_BEGIN(sample);
+    MsgpackReader reader(input.ptr(), input.size());
+    reader.key_cache = batch->intern_keys ? MsgpackKeyCache::get_thread_cache() : nullptr;
+    reader.flags = batch->flags;
+    batch->outputs[index] = _unpack_root(reader, batch->max_decompressed_size, batch->errors[index]);
+    MSGPACK_STATS_END_UNPACK(sample, input.size(), batch->errors[index].failed());
+}
+
+void Msgpack::_unpack_split_task(void *userdata, uint32_t index) {
+    UnpackSplit *split = (UnpackSplit *)userdata;
+    MsgpackError &error = split->errors[index];
+    MsgpackReader reader(split->data, split->size);
+    reader.key_cache = split->intern_keys ? MsgpackKeyCache::get_thread_cache() : nullptr;
+    reader.flags = split->flags;
+    // Inside the top-level container.
+    reader.depth = 1;
+    reader.get_data(split->offsets[split->chunks[index]]);
+
+    for (uint32_t i = split->chunks[index]; i < split->chunks[index + 1]; i++) {
+        if (split->map && (reader.key_cache == nullptr || !reader.key_cache->unpack_key(reader, split->keys[i]))) {
+            split->keys[i] = _unpack(reader, error);
+        }
+        if (!error.failed()) {
+            split->values[i] = _unpack(reader, error);
+        }
+        if (error.failed()) {
+            return;
+        }
+    }
+}
+
+int64_t Msgpack::_start_async(const Variant& data, bool unpack, const Callable& callback, uint32_t flags, int64_t max_decompressed_size) {
+    AsyncTask *task = memnew(AsyncTask);
+    task->id = next_async_id++;
+    task->unpack = unpack;
+    task->flags = flags;
+    task->max_decompressed_size = max_decompressed_size;
+    task->input = data;
+    task->callback = callback;
+    task->intern_keys = intern_keys;
+    async_tasks.insert(task->id, task);
+
+    task->pool_task = WorkerThreadPool::get_singleton()->add_native_task(&Msgpack::_async_task, task, false, unpack ? "Msgpack::unpack_async" : "Msgpack::pack_async");
+    return task->id;
+}
 
-void Msgpack::_pack(const Variant& data, StreamPeerBuffer *buffer, Dictionary &error) {
+void Msgpack::_async_task(void *userdata) {
+    AsyncTask *task = (AsyncTask *)userdata;
+
+    if (!task->cancelled.load()) {
+        MSGPACK_STATS_BEGIN(sample);
+        if (task->unpack) {
+            PackedByteArray input = task->input;
+            MsgpackReader reader(input.ptr(), input.size());
+            reader.key_cache = task->intern_keys ? MsgpackKeyCache::get_thread_cache() : nullptr;
+            reader.flags = task->flags;
+            task->output = _unpack_root(reader, task->max_decompressed_size, task->error);
+            MSGPACK_STATS_END_UNPACK(sample, input.size(), task->error.failed());
+        } else {
+            MsgpackWriter writer(_estimate_size(task->input));
+            writer.flags = task->flags;
+            _pack(task->input, writer, task->error);
+            MSGPACK_STATS_END_PACK(sample, writer.get_size(), task->error.failed());
+            task->output = task->error.failed() ? PackedByteArray() : _finish(writer, task->error);
+        }
+    }
+    // The pool task is waited for and released on the main thread.
+    if (msgpack != nullptr) {
+        msgpack->call_deferred("_async_finished", task->id);
+    }
+}
+
+void Msgpack::_async_finished(int64_t task_id) {
+    AsyncTask **task_ptr = async_tasks.getptr(task_id);
+    ERR_FAIL_NULL(task_ptr);
+    AsyncTask *task = *task_ptr;
+    async_tasks.erase(task_id);
+
+    WorkerThreadPool::get_singleton()->wait_for_task_completion(task->pool_task);
+    if (!task->cancelled.load()) {
+        StringName signal = task->unpack ? "unpack_completed" : "pack_completed";
+        emit_signal(signal, task->id, task->output, task->error.code);
+        if (task->callback.is_valid()) {
+            task->callback.call(task->id, task->output, task->error.code);
+        }
+    }
+    memdelete(task);
+}
+
+void Msgpack::_print_error(const MsgpackError &error) {
+    if (error.code == Error::ERR_INVALID_DATA && error.type != Variant::NIL) {
+        UtilityFunctions::print("Unsupported data type: " + Variant::get_type_name(error.type));
+    } else {
+        UtilityFunctions::print(error.message);
+    }
+}
+
+// Arrays nested deeper than this are not sampled, so estimating stays cheap.
+static const int64_t MSGPACK_ESTIMATE_DEPTH = 3;
+// Elements sampled per array.
+static const int64_t MSGPACK_ESTIMATE_SAMPLES = 8;
+// Largest estimate for a container, a sample is a guess and must not reserve
+// far more than the data needs.
+static const int64_t MSGPACK_ESTIMATE_MAX = 16 * 1024 * 1024;
+
+int64_t Msgpack::_estimate_size(const Variant& data, int64_t depth) {
+    // Cheap guess of the packed size used to reserve the output once.
+    // Arrays are sampled at a few elements spread over them instead of
+    // walked, the writer grows if the guess falls short.
+    switch (data.get_type()) {
+        case Variant::Type::NIL:
+        case Variant::Type::BOOL: {
+            return 1;
+        }
+        case Variant::Type::INT:
+        case Variant::Type::FLOAT: {
+            return 9;
+        }
+        case Variant::Type::STRING:
+        case Variant::Type::STRING_NAME:
+        case Variant::Type::NODE_PATH: {
+            return 5 + data.operator String().length() * 2;
+        }
+        case Variant::Type::PACKED_BYTE_ARRAY: {
+            return 5 + data.operator PackedByteArray().size();
+        }
+        case Variant::Type::ARRAY: {
+            Array p_data = data.operator Array();
+            int64_t count = p_data.size();
+            if (count == 0) {
+                return 1;
+            }
+            if (depth >= MSGPACK_ESTIMATE_DEPTH) {
+                return MIN(5 + count * 16, MSGPACK_ESTIMATE_MAX);
+            }
+            int64_t samples = MIN(count, MSGPACK_ESTIMATE_SAMPLES);
+            int64_t sampled = 0;
+            for (int64_t i = 0; i < samples; i++) {
+                sampled += _estimate_size(p_data[i * count / samples], depth + 1);
+            }
+            // Dividing first keeps the product within range.
+            return MIN(5 + sampled / samples * count, MSGPACK_ESTIMATE_MAX);
+        }
+        case Variant::Type::DICTIONARY: {
+            return MIN(5 + data.operator Dictionary().size() * 16, MSGPACK_ESTIMATE_MAX);
+        }
+        case Variant::Type::PACKED_INT32_ARRAY: {
+            return 6 + data.operator PackedInt32Array().size() * 4;
+        }
+        case Variant::Type::PACKED_INT64_ARRAY: {
+            return 6 + data.operator PackedInt64Array().size() * 8;
+        }
+        case Variant::Type::PACKED_FLOAT32_ARRAY: {
+            return 6 + data.operator PackedFloat32Array().size() * 4;
+        }
+        case Variant::Type::PACKED_FLOAT64_ARRAY: {
+            return 6 + data.operator PackedFloat64Array().size() * 8;
+        }
+        case Variant::Type::PACKED_VECTOR2_ARRAY: {
+            return 6 + data.operator PackedVector2Array().size() * int64_t(sizeof(Vector2));
+        }
+        case Variant::Type::PACKED_VECTOR3_ARRAY: {
+            return 6 + data.operator PackedVector3Array().size() * int64_t(sizeof(Vector3));
+        }
+        case Variant::Type::PACKED_COLOR_ARRAY: {
+            return 6 + data.operator PackedColorArray().size() * int64_t(sizeof(Color));
+        }
+        default: {
+            return 16;
+        }
+    }
+}
+
+void Msgpack::_pack(const Variant& data, MsgpackWriter &writer, MsgpackError &error) {
+    MSGPACK_STATS_TYPE(pack_types, data.get_type());
     switch (data.get_type()) {
         case Variant::Type::NIL: {
-            buffer->put_u8(MSGPACK_FORMAT_NIL);
+            msgpack_core::write_nil(writer);
             break;
         }
         case Variant::Type::BOOL: {
-            bool p_data = bool(data);
-
-            if (p_data) {
-                buffer->put_u8(MSGPACK_FORMAT_TRUE);
-            } else {
-                buffer->put_u8(MSGPACK_FORMAT_FALSE);
-            }
+            msgpack_core::write_bool(writer, bool(data));
             break;
         }
         case Variant::Type::INT: {
-            auto p_data = int64_t(data);
-
-            if (-(1 << 5) <= p_data && p_data <= (1 << 7) - 1) {
-                buffer->put_8(int8_t(p_data));
-            } else if (-(1 << 7) <= p_data and p_data <= (1 << 7)) {
-                buffer->put_u8(MSGPACK_FORMAT_INT_8);
-                buffer->put_8(int8_t(p_data));
-            } else if (-(1 << 15) <= p_data and p_data <= (1 << 15)) {
-                buffer->put_u8(MSGPACK_FORMAT_INT_16);
-                buffer->put_16(int16_t(p_data));
-            } else if (-(int64_t(1) << 31) <= p_data and p_data <= (int64_t(1) << 31)) {
-                buffer->put_u8(MSGPACK_FORMAT_INT_32);
-                buffer->put_32(int32_t(p_data));
+            if (writer.flags & PACK_COMPACT_NUMBERS) {
+                msgpack_core::write_compact_int(writer, int64_t(data));
             } else {
-                buffer->put_u8(MSGPACK_FORMAT_INT_64);
-                buffer->put_64(int64_t(p_data));
+                msgpack_core::write_int(writer, int64_t(data));
             }
             break;
         }
         case Variant::Type::FLOAT: {
-            auto p_data = float(data);
-
-            buffer->put_u8(MSGPACK_FORMAT_FLOAT_32);
-            buffer->put_float(p_data);
+            if (writer.flags & PACK_COMPACT_NUMBERS) {
+                msgpack_core::write_compact_real(writer, double(data));
+            } else {
+                msgpack_core::write_float(writer, float(data));
+            }
             break;
         }
         case Variant::Type::STRING: {
-            PackedByteArray p_data = data.operator String().to_utf8_buffer();
-            int64_t p_data_size = p_data.size();
-
-            if (p_data_size <= (1 << 5) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_FIXSTR | p_data_size);
-            } else if (p_data_size <= (1 << 8) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_STR_8);
-                buffer->put_u8(p_data_size);
-            } else if (p_data_size <= (1 << 16) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_STR_16);
-                buffer->put_u16(p_data_size);
-            } else if (p_data_size <= (int64_t(1) << 32) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_STR_32);
-                buffer->put_u32(p_data_size);
-            } else {
-                error["error"] = Error::FAILED;
-                error["error_message"] = "PackedByteArray size out of range!";
+            _pack_string(data.operator String(), writer, error);
+            break;
+        }
+        case Variant::Type::STRING_NAME: {
+            if (!MsgpackNameCache::get_thread_cache()->pack(data.operator StringName(), writer)) {
+                error.set(Error::ERR_OUT_OF_MEMORY, writer.get_size(), "String size out of range!");
+                return;
             }
-            buffer->put_data(p_data);
+            break;
+        }
+        case Variant::Type::NODE_PATH: {
+            _pack_string(String(data.operator NodePath()), writer, error);
             break;
         }
         case Variant::Type::ARRAY: {
             Array p_data = data.operator Array();
             int64_t p_data_size = p_data.size();
 
-            if (p_data_size <= 15) {
-                buffer->put_u8(0x90 | p_data_size);
-            } else if (p_data_size <= (1 << 16) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_ARRAY_16);
-                buffer->put_u16(p_data_size);
-            } else if (p_data_size <= (int64_t(1) << 32) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_ARRAY_32);
-                buffer->put_u32(p_data_size);
-            } else {
-                error["error"] = Error::FAILED;
-                error["error_message"] = "Array size out of range!";
+            _pack_array_header(writer, p_data_size, error);
+            if (error.failed() || _pack_homogeneous(p_data, writer, error)) {
+                return;
             }
             for (int idx = 0; idx < p_data_size; idx++) {
-                _pack(p_data[idx], buffer, error);
-                if (int(error.get("error", Error::FAILED)) != Error::OK) {
+                _pack(p_data[idx], writer, error);
+                if (error.failed()) {
                     return;
                 }
             }
@@ -153,341 +726,1141 @@ void Msgpack::_pack(const Variant& data, StreamPeerBuffer *buffer, Dictionary &e
         }
         case Variant::Type::PACKED_BYTE_ARRAY: {
             PackedByteArray p_data = data.operator PackedByteArray();
-            int64_t p_data_size = p_data.size();
-
-            if (p_data_size <= (1 << 8) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_BIN_8);
-                buffer->put_u8(p_data_size);
-            } else if (p_data_size <= (1 << 16) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_BIN_16);
-                buffer->put_u8(p_data_size);
-            } else if (p_data_size <= (int64_t(1) << 32) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_BIN_32);
-                buffer->put_u8(p_data_size);
-            } else {
-                error["error"] = Error::FAILED;
-                error["error_message"] = "PackedByteArray size out of range!";
+            if (!msgpack_core::write_bin(writer, p_data.ptr(), p_data.size())) {
+                error.set(Error::ERR_OUT_OF_MEMORY, writer.get_size(), "PackedByteArray size out of range!");
+                return;
             }
-            buffer->put_data(p_data);
             break;
         }
         case Variant::Type::DICTIONARY: {
             Dictionary p_data = data.operator Dictionary();
             int64_t p_data_size = p_data.size();
 
-            if (p_data_size <= 15) {
-                buffer->put_u8(MSGPACK_FORMAT_FIXMAP | p_data_size);
-            } else if (p_data_size <= (1 << 16) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_MAP_16);
-                buffer->put_u16(p_data_size);
-            } else if (p_data_size <= (int64_t(1) << 32) - 1) {
-                buffer->put_u8(MSGPACK_FORMAT_MAP_32);
-                buffer->put_u32(p_data_size);
-            } else {
-                error["error"] = Error::FAILED;
-                error["error_message"] = "Dictionary size out of range!";
+            _pack_map_header(writer, p_data_size, error);
+            if (error.failed()) {
+                return;
             }
             Array p_data_keys = p_data.keys();
             Array p_data_values = p_data.values();
             for (int idx = 0; idx < p_data_size; idx++) {
-                _pack(p_data_keys[idx], buffer, error);
-                if (int(error.get("error", Error::FAILED)) != Error::OK) {
+                _pack(p_data_keys[idx], writer, error);
+                if (error.failed()) {
                     return;
                 }
 
-                _pack(p_data_values[idx], buffer, error);
-                if (int(error.get("error", Error::FAILED)) != Error::OK) {
+                _pack(p_data_values[idx], writer, error);
+                if (error.failed()) {
                     return;
                 }
             }
             break;
         }
-        default: {
-            error["error"] = Error::ERR_INVALID_DATA;
-            error["error_message"] = "Unsupported data type: " + Variant::get_type_name(data.get_type());
+        case Variant::Type::PACKED_INT32_ARRAY: {
+            PackedInt32Array p_data = data.operator PackedInt32Array();
+            _pack_ext_swapped(writer, MSGPACK_EXT_PACKED_INT32_ARRAY, p_data.ptr(), p_data.size(), 4, error);
             break;
         }
-    }
-}
-
-Variant Msgpack::_unpack(StreamPeerBuffer *buffer, Dictionary &error) {
-    if (buffer->get_position() == buffer->get_size()) {
-        error["error"] = Error::FAILED;
-        error["error_message"] = "Unexpected end of input!";
-        return nullptr;
-    }
-    uint8_t head = buffer->get_u8();
-
-    if (head == MSGPACK_FORMAT_NIL) {
-        return nullptr;
-    } else if (head == MSGPACK_FORMAT_FALSE) {
-        return false;
-    } else if (head == MSGPACK_FORMAT_TRUE) {
-        return true;
-    } else if ((head & MSGPACK_FORMAT_FIXMAP) == 0) {
-        return head;
-    } else if (((~head) & MSGPACK_FORMAT_NEGATIVE_FIXINT) == 0) {
-        return head - 256;
-    } else if (head == MSGPACK_FORMAT_UINT_8) {
-        if (buffer->get_size() - buffer->get_position() < 1) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for UINT_8!";
-            return nullptr;
-        }
-        return buffer->get_u8();
-    } else if (head == MSGPACK_FORMAT_UINT_16) {
-        if (buffer->get_size() - buffer->get_position() < 2) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for UINT_16!";
-            return nullptr;
-        }
-        return buffer->get_u16();
-    } else if (head == MSGPACK_FORMAT_UINT_32) {
-        if (buffer->get_size() - buffer->get_position() < 4) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for UINT_32!";
-            return nullptr;
-        }
-        return buffer->get_u32();
-    } else if (head == MSGPACK_FORMAT_UINT_64) {
-        if (buffer->get_size() - buffer->get_position() < 8) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for UINT_64!";
-            return nullptr;
-        }
-        return buffer->get_u64();
-    } else if (head == MSGPACK_FORMAT_INT_8) {
-        if (buffer->get_size() - buffer->get_position() < 1) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for INT_8!";
-            return nullptr;
-        }
-        return buffer->get_8();
-    } else if (head == MSGPACK_FORMAT_INT_16) {
-        if (buffer->get_size() - buffer->get_position() < 2) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for INT_16!";
-            return nullptr;
-        }
-        return buffer->get_16();
-    } else if (head == MSGPACK_FORMAT_INT_32) {
-        if (buffer->get_size() - buffer->get_position() < 4) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for INT_32!";
-            return nullptr;
-        }
-        return buffer->get_32();
-    } else if (head == MSGPACK_FORMAT_INT_64) {
-        if (buffer->get_size() - buffer->get_position() < 8) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for INT_64!";
-            return nullptr;
-        }
-        return buffer->get_64();
-    } else if (head == MSGPACK_FORMAT_FLOAT_32) {
-        if (buffer->get_size() - buffer->get_position() < 4) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for FLOAT_32!";
-            return nullptr;
+        case Variant::Type::PACKED_INT64_ARRAY: {
+            PackedInt64Array p_data = data.operator PackedInt64Array();
+            _pack_ext_swapped(writer, MSGPACK_EXT_PACKED_INT64_ARRAY, p_data.ptr(), p_data.size(), 8, error);
+            break;
         }
-        return buffer->get_float();
-    } else if (head == MSGPACK_FORMAT_FLOAT_64) {
-        if (buffer->get_size() - buffer->get_position() < 4) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for FLOAT_64!";
-            return nullptr;
+        case Variant::Type::PACKED_FLOAT32_ARRAY: {
+            PackedFloat32Array p_data = data.operator PackedFloat32Array();
+            _pack_ext_swapped(writer, MSGPACK_EXT_PACKED_FLOAT32_ARRAY, p_data.ptr(), p_data.size(), 4, error);
+            break;
         }
-        return buffer->get_double();
-    } else if (((~head) & MSGPACK_FORMAT_FIXSTR) == 0) {
-        int32_t size = head & 0x1f;
-        if (buffer->get_size() - buffer->get_position() < size) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for FIXSTR!";
-            return nullptr;
+        case Variant::Type::PACKED_FLOAT64_ARRAY: {
+            PackedFloat64Array p_data = data.operator PackedFloat64Array();
+            _pack_ext_swapped(writer, MSGPACK_EXT_PACKED_FLOAT64_ARRAY, p_data.ptr(), p_data.size(), 8, error);
+            break;
         }
-        return buffer->get_utf8_string(size);
-    } else if (head == MSGPACK_FORMAT_STR_8) {
-        if (buffer->get_size() - buffer->get_position() < 1) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for STR_8 size!";
-            return nullptr;
+        case Variant::Type::PACKED_VECTOR2_ARRAY: {
+            PackedVector2Array p_data = data.operator PackedVector2Array();
+#ifdef REAL_T_IS_DOUBLE
+            _pack_ext_swapped(writer, MSGPACK_EXT_PACKED_VECTOR2_ARRAY_64, p_data.ptr(), p_data.size() * 2, 8, error);
+#else
+            _pack_ext_swapped(writer, MSGPACK_EXT_PACKED_VECTOR2_ARRAY, p_data.ptr(), p_data.size() * 2, 4, error);
+#endif
+            break;
         }
-        int32_t size = buffer->get_u8();
-        if (buffer->get_size() - buffer->get_position() < size) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for STR_8!";
-            return nullptr;
+        case Variant::Type::PACKED_VECTOR3_ARRAY: {
+            PackedVector3Array p_data = data.operator PackedVector3Array();
+#ifdef REAL_T_IS_DOUBLE
+            _pack_ext_swapped(writer, MSGPACK_EXT_PACKED_VECTOR3_ARRAY_64, p_data.ptr(), p_data.size() * 3, 8, error);
+#else
+            _pack_ext_swapped(writer, MSGPACK_EXT_PACKED_VECTOR3_ARRAY, p_data.ptr(), p_data.size() * 3, 4, error);
+#endif
+            break;
         }
-        return buffer->get_utf8_string(size);
-    } else if (head == MSGPACK_FORMAT_STR_16) {
-        if (buffer->get_size() - buffer->get_position() < 2) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for STR_16 size!";
-            return nullptr;
+        case Variant::Type::PACKED_COLOR_ARRAY: {
+            PackedColorArray p_data = data.operator PackedColorArray();
+            _pack_ext_swapped(writer, MSGPACK_EXT_PACKED_COLOR_ARRAY, p_data.ptr(), p_data.size() * 4, 4, error);
+            break;
         }
-        int32_t size = buffer->get_u16();
-        if (buffer->get_size() - buffer->get_position() < size) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for STR_16!";
-            return nullptr;
+        case Variant::Type::VECTOR2: {
+            Vector2 p_data = data.operator Vector2();
+            _pack_ext_swapped(writer, MSGPACK_EXT_VECTOR2, &p_data, 2, sizeof(real_t), error);
+            break;
         }
-        return buffer->get_utf8_string(size);
-    } else if (head == MSGPACK_FORMAT_STR_32) {
-        if (buffer->get_size() - buffer->get_position() < 4) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for STR_32 size!";
-            return nullptr;
+        case Variant::Type::VECTOR3: {
+            Vector3 p_data = data.operator Vector3();
+            _pack_ext_swapped(writer, MSGPACK_EXT_VECTOR3, &p_data, 3, sizeof(real_t), error);
+            break;
         }
-        int64_t size = buffer->get_u32();
-        if (buffer->get_size() - buffer->get_position() < size) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for STR_32!";
-            return nullptr;
+        case Variant::Type::VECTOR4: {
+            Vector4 p_data = data.operator Vector4();
+            _pack_ext_swapped(writer, MSGPACK_EXT_VECTOR4, &p_data, 4, sizeof(real_t), error);
+            break;
         }
-        return buffer->get_utf8_string(int32_t(size));
-    } else if (head == MSGPACK_FORMAT_BIN_8) {
-        if (buffer->get_size() - buffer->get_position() < 1) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for BIN_8 size!";
-            return nullptr;
+        case Variant::Type::QUATERNION: {
+            Quaternion p_data = data.operator Quaternion();
+            _pack_ext_swapped(writer, MSGPACK_EXT_QUATERNION, &p_data, 4, sizeof(real_t), error);
+            break;
         }
-        int32_t size = buffer->get_u8();
-        if (buffer->get_size() - buffer->get_position() < size) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for BIN_8!";
-            return nullptr;
+        case Variant::Type::COLOR: {
+            Color p_data = data.operator Color();
+            _pack_ext_swapped(writer, MSGPACK_EXT_COLOR, &p_data, 4, 4, error);
+            break;
         }
-        Array res = buffer->get_data(size);
-//        assert(int(res[0]) == Error::OK);
-        return res[1];
-    } else if (head == MSGPACK_FORMAT_BIN_16) {
-        if (buffer->get_size() - buffer->get_position() < 2) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for BIN_16 size";
-            return nullptr;
+        case Variant::Type::RECT2: {
+            Rect2 p_data = data.operator Rect2();
+            _pack_ext_swapped(writer, MSGPACK_EXT_RECT2, &p_data, 4, sizeof(real_t), error);
+            break;
         }
-        int32_t size = buffer->get_u16();
-        if (buffer->get_size() - buffer->get_position() < size) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for BIN_16!";
-            return nullptr;
+        case Variant::Type::AABB: {
+            AABB p_data = data;
+            _pack_ext_swapped(writer, MSGPACK_EXT_AABB, &p_data, 6, sizeof(real_t), error);
+            break;
         }
-        Array res = buffer->get_data(size);
-//        assert(int(res[0]) == Error::OK);
-        return res[1];
-    } else if (head == MSGPACK_FORMAT_BIN_32) {
-        if (buffer->get_size() - buffer->get_position() < 4) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for BIN_32 size!";
-            return nullptr;
+        case Variant::Type::BASIS: {
+            Basis p_data = data.operator Basis();
+            _pack_ext_swapped(writer, MSGPACK_EXT_BASIS, &p_data, 9, sizeof(real_t), error);
+            break;
         }
-        int64_t size = buffer->get_u32();
-        if (buffer->get_size() - buffer->get_position() < size) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for BIN_32!";
-            return nullptr;
+        case Variant::Type::TRANSFORM3D: {
+            Transform3D p_data = data.operator Transform3D();
+            _pack_ext_swapped(writer, MSGPACK_EXT_TRANSFORM3D, &p_data, 12, sizeof(real_t), error);
+            break;
         }
-        Array res = buffer->get_data(int32_t(size));
-//        assert(res[0] == OK);
-        return res[1];
-    } else if ((head & 0xF0) == MSGPACK_FORMAT_FIXARRAY) {
-        int32_t size = head & 0x0f;
-        Array res;
-        for (int i = 0; i < size; i++) {
-            res.append(_unpack(buffer, error));
-            if (int(error.get("error", Error::FAILED)) != Error::OK) {
-                return nullptr;
+        case Variant::Type::OBJECT: {
+            if (writer.flags & PACK_OBJECTS) {
+                Object *p_data = data;
+                if (p_data == nullptr) {
+                    msgpack_core::write_nil(writer);
+                } else {
+                    _pack_object(p_data, writer, error);
+                }
+                break;
             }
+            error.set(Error::ERR_INVALID_DATA, writer.get_size(), "Unsupported data type!");
+            error.type = data.get_type();
+            break;
         }
-        return res;
-    } else if (head == MSGPACK_FORMAT_ARRAY_16) {
-        if (buffer->get_size() - buffer->get_position() < 2) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for ARRAY_16 size!";
-            return nullptr;
+        default: {
+            error.set(Error::ERR_INVALID_DATA, writer.get_size(), "Unsupported data type!");
+            error.type = data.get_type();
+            break;
         }
-        int32_t size = buffer->get_u16();
-        Array res;
-        for (int i = 0; i < size; i++) {
-            res.append(_unpack(buffer, error));
-            if (int(error.get("error", Error::FAILED)) != Error::OK) {
-                return nullptr;
+    }
+    if (unlikely(writer.is_failed()) && !error.failed()) {
+        error.set(Error::ERR_OUT_OF_MEMORY, writer.get_size(), "Out of memory!");
+    }
+}
+
+void Msgpack::_pack_array_header(MsgpackWriter &writer, int64_t size, MsgpackError &error) {
+    if (!msgpack_core::write_array_header(writer, size)) {
+        error.set(Error::ERR_OUT_OF_MEMORY, writer.get_size(), "Array size out of range!");
+    }
+}
+
+void Msgpack::_pack_map_header(MsgpackWriter &writer, int64_t size, MsgpackError &error) {
+    if (!msgpack_core::write_map_header(writer, size)) {
+        error.set(Error::ERR_OUT_OF_MEMORY, writer.get_size(), "Dictionary size out of range!");
+    }
+}
+
+void Msgpack::_pack_ext_header(MsgpackWriter &writer, int8_t type, int64_t length, MsgpackError &error) {
+    if (!msgpack_core::write_ext_header(writer, type, length)) {
+        error.set(Error::ERR_OUT_OF_MEMORY, writer.get_size(), "Ext size out of range!");
+    }
+}
+
+void Msgpack::_pack_string(const String& string, MsgpackWriter &writer, MsgpackError &error) {
+    // Counting the UTF-8 length first lets the header go out before the
+    // characters, which are then encoded straight into the output.
+    const char32_t *chars = string.ptr();
+    int64_t count = string.length();
+    int64_t length = msgpack_utf8_length(chars, count);
+    if (!msgpack_core::write_str_header(writer, length)) {
+        error.set(Error::ERR_OUT_OF_MEMORY, writer.get_size(), "String size out of range!");
+        return;
+    }
+    uint8_t *dst = length > 0 ? writer.put_space(length) : nullptr;
+    if (dst != nullptr) {
+        msgpack_utf8_encode(dst, chars, count);
+    }
+}
+
+String Msgpack::_unpack_string(const uint8_t *data, int64_t length) {
+    if (length == 0) {
+        return String();
+    }
+    // String::utf8 skips a leading BOM, leave that case to it.
+    if (length >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
+        return String::utf8((const char *)data, int32_t(length));
+    }
+    String res;
+    res.resize(length + 1);
+    char32_t *w = res.ptrw();
+    int64_t count = msgpack_utf8_decode(w, data, length);
+    if (count < 0) {
+        return String::utf8((const char *)data, int32_t(length));
+    }
+    w[count] = 0;
+    if (count < length) {
+        res.resize(count + 1);
+    }
+    return res;
+}
+
+void Msgpack::_pack_timestamp(MsgpackWriter &writer, double unix_time, MsgpackError &error) {
+    // Outside of +-2^63 seconds the conversion below is undefined.
+    if (!std::isfinite(unix_time) || std::fabs(unix_time) >= 9.2e18) {
+        error.set(Error::ERR_INVALID_PARAMETER, writer.get_size(), "Timestamp out of range!");
+        return;
+    }
+    double seconds = std::floor(unix_time);
+    int64_t nanoseconds = int64_t(std::round((unix_time - seconds) * 1e9));
+    if (nanoseconds >= 1000000000) {
+        seconds += 1;
+        nanoseconds -= 1000000000;
+    }
+    msgpack_core::write_timestamp(writer, int64_t(seconds), uint32_t(nanoseconds));
+}
+
+// Sink for building a header on the stack.
+struct MsgpackHeaderSink {
+    uint8_t bytes[6];
+    int64_t size = 0;
+
+    void put_u8(uint8_t p_value) {
+        bytes[size++] = p_value;
+    }
+
+    void put_u16(uint16_t p_value) {
+        put_u8(uint8_t(p_value >> 8));
+        put_u8(uint8_t(p_value));
+    }
+
+    void put_u32(uint32_t p_value) {
+        put_u16(uint16_t(p_value >> 16));
+        put_u16(uint16_t(p_value));
+    }
+};
+
+int64_t Msgpack::_pack_ext_begin(MsgpackWriter &writer) {
+    int64_t offset = writer.get_size();
+    writer.put_space(6);
+    return offset;
+}
+
+void Msgpack::_pack_ext_end(MsgpackWriter &writer, int64_t offset, int8_t type, MsgpackError &error) {
+    if (writer.is_failed()) {
+        error.set(Error::ERR_OUT_OF_MEMORY, offset, "Out of memory!");
+        return;
+    }
+    int64_t payload = offset + 6;
+    int64_t length = writer.get_size() - payload;
+    MsgpackHeaderSink header;
+    if (!msgpack_core::write_ext_header(header, type, length)) {
+        error.set(Error::ERR_OUT_OF_MEMORY, offset, "Ext size out of range!");
+        return;
+    }
+    uint8_t *dst = writer.get_data_at(offset);
+    if (header.size < 6 && length > 0) {
+        memmove(dst + header.size, dst + 6, length);
+    }
+    memcpy(dst, header.bytes, header.size);
+    writer.truncate(offset + header.size + length);
+}
+
+bool Msgpack::_pack_delta(const Variant& previous, const Variant& current, MsgpackWriter &writer, MsgpackError &error, bool root) {
+    Variant::Type type = current.get_type();
+    if (type != previous.get_type() || (type != Variant::DICTIONARY && type != Variant::ARRAY)) {
+        if (!root && type == previous.get_type() && current == previous) {
+            return false;
+        }
+        _pack(current, writer, error);
+        return true;
+    }
+
+    // Unchanged children are rolled back, so only the changed paths remain.
+    int64_t start = writer.get_size();
+    int64_t ext = _pack_ext_begin(writer);
+    bool changed = false;
+
+    if (type == Variant::DICTIONARY) {
+        Dictionary prev = previous;
+        Dictionary cur = current;
+        Array keys = cur.keys();
+        Array values = cur.values();
+        for (int64_t i = 0; i < keys.size() && !error.failed(); i++) {
+            int64_t mark = writer.get_size();
+            _pack(keys[i], writer, error);
+            const Variant *prev_value = prev.has(keys[i]) ? &prev[keys[i]] : nullptr;
+            if (prev_value == nullptr) {
+                _pack(values[i], writer, error);
+                changed = true;
+            } else if (_pack_delta(*prev_value, values[i], writer, error, false)) {
+                changed = true;
+            } else {
+                writer.truncate(mark);
             }
         }
+        Array prev_keys = prev.keys();
+        for (int64_t i = 0; i < prev_keys.size() && !error.failed(); i++) {
+            if (!cur.has(prev_keys[i])) {
+                _pack(prev_keys[i], writer, error);
+                _pack_ext_header(writer, MSGPACK_EXT_DELTA_REMOVE, 1, error);
+                writer.put_u8(0);
+                changed = true;
+            }
+        }
+        if (!error.failed()) {
+            _pack_ext_end(writer, ext, MSGPACK_EXT_DELTA_MAP, error);
+        }
+    } else {
+        Array prev = previous;
+        Array cur = current;
+        msgpack_core::write_int(writer, cur.size());
+        changed = cur.size() != prev.size();
+        for (int64_t i = 0; i < cur.size() && !error.failed(); i++) {
+            int64_t mark = writer.get_size();
+            msgpack_core::write_int(writer, i);
+            if (i >= prev.size()) {
+                _pack(cur[i], writer, error);
+                changed = true;
+            } else if (_pack_delta(prev[i], cur[i], writer, error, false)) {
+                changed = true;
+            } else {
+                writer.truncate(mark);
+            }
+        }
+        if (!error.failed()) {
+            _pack_ext_end(writer, ext, MSGPACK_EXT_DELTA_ARRAY, error);
+        }
+    }
+
+    if (!changed && !root) {
+        writer.truncate(start);
+    }
+    return changed;
+}
+
+Variant Msgpack::_apply_delta(const Variant& previous, MsgpackReader &reader, MsgpackError &error) {
+    MsgpackReader probe = reader;
+    msgpack_core::Item item;
+    msgpack_core::Result result;
+    if (!msgpack_core::read_item(probe, item, result)) {
+        error.set(result);
+        return Variant();
+    }
+    bool is_map = item.kind == msgpack_core::KIND_EXT && item.ext_type == MSGPACK_EXT_DELTA_MAP;
+    bool is_array = item.kind == msgpack_core::KIND_EXT && item.ext_type == MSGPACK_EXT_DELTA_ARRAY;
+    if (!is_map && !is_array) {
+        return _unpack(reader, error);
+    }
+
+    if (!_check_depth(reader, reader.get_position(), error)) {
+        return Variant();
+    }
+    int64_t base = probe.get_position() - item.length;
+    MsgpackReader payload(item.data, item.length);
+    payload.key_cache = reader.key_cache;
+    payload.depth = reader.depth + 1;
+    reader = probe;
+
+    if (is_map) {
+        // Containers the patch does not touch are shared with previous.
+        Dictionary res = previous.get_type() == Variant::DICTIONARY ? Dictionary(previous).duplicate() : Dictionary();
+        while (payload.get_available() > 0) {
+            Variant key = _unpack(payload, error);
+            if (error.failed()) {
+                break;
+            }
+            MsgpackReader remove = payload;
+            if (msgpack_core::read_item(remove, item, result) && item.kind == msgpack_core::KIND_EXT && item.ext_type == MSGPACK_EXT_DELTA_REMOVE) {
+                res.erase(key);
+                payload = remove;
+                continue;
+            }
+            res[key] = _apply_delta(res.get(key, Variant()), payload, error);
+            if (error.failed()) {
+                break;
+            }
+        }
+        if (error.failed()) {
+            error.offset += base;
+            return Variant();
+        }
         return res;
-    } else if (head == MSGPACK_FORMAT_ARRAY_32) {
-        if (buffer->get_size() - buffer->get_position() < 4) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for ARRAY_32 size!";
-            return nullptr;
+    }
+
+    Array res = previous.get_type() == Variant::ARRAY ? Array(previous).duplicate() : Array();
+    int64_t size_offset = payload.get_position();
+    Variant size = _unpack(payload, error);
+    if (!error.failed() && (size.get_type() != Variant::INT || int64_t(size) < 0 || int64_t(size) > res.size() + payload.get_available())) {
+        error.set(Error::ERR_INVALID_DATA, size_offset, "Invalid array size in delta!");
+    }
+    if (!error.failed()) {
+        res.resize(int64_t(size));
+    }
+    while (!error.failed() && payload.get_available() > 0) {
+        int64_t index_offset = payload.get_position();
+        Variant index = _unpack(payload, error);
+        if (error.failed()) {
+            break;
+        }
+        if (index.get_type() != Variant::INT || int64_t(index) < 0 || int64_t(index) >= res.size()) {
+            error.set(Error::ERR_INVALID_DATA, index_offset, "Invalid array index in delta!");
+            break;
+        }
+        int64_t i = index;
+        res[i] = _apply_delta(res[i], payload, error);
+    }
+    if (error.failed()) {
+        error.offset += base;
+        return Variant();
+    }
+    return res;
+}
+
+// Objects being packed on this thread, outermost first.
+static thread_local LocalVector<Object *> _packing_objects;
+
+void Msgpack::_pack_object(Object *object, MsgpackWriter &writer, MsgpackError &error) {
+    for (Object *ancestor : _packing_objects) {
+        if (ancestor == object) {
+            error.set(Error::ERR_CYCLIC_LINK, writer.get_size(), "Object references itself!");
+            return;
+        }
+    }
+
+    String class_name = object->get_class();
+    const MsgpackObjectCache::Entry *entry = MsgpackObjectCache::get_thread_cache()->get(object, class_name);
+    String script_path;
+    LocalVector<StringName> properties;
+    if (entry != nullptr) {
+        script_path = entry->script_path;
+    } else {
+        Resource *script = Object::cast_to<Resource>(object->get_script());
+        if (script != nullptr) {
+            script_path = script->get_path();
+        }
+    }
+    if (entry == nullptr || entry->per_instance) {
+        MsgpackObjectCache::read_properties(object, properties);
+    }
+
+    _packing_objects.push_back(object);
+    int64_t ext = _pack_ext_begin(writer);
+    _pack(class_name, writer, error);
+    if (script_path.is_empty()) {
+        msgpack_core::write_nil(writer);
+    } else {
+        _pack(script_path, writer, error);
+    }
+    if (entry != nullptr && !entry->per_instance) {
+        _pack_map_header(writer, entry->properties.size(), error);
+        const uint8_t *names = entry->encoded_names.ptr();
+        for (uint32_t i = 0; i < entry->properties.size() && !error.failed(); i++) {
+            writer.put_data(names + entry->offsets[i], entry->offsets[i + 1] - entry->offsets[i]);
+            _pack(object->get(entry->properties[i]), writer, error);
+        }
+    } else {
+        _pack_map_header(writer, properties.size(), error);
+        for (uint32_t i = 0; i < properties.size() && !error.failed(); i++) {
+            _pack(properties[i], writer, error);
+            if (!error.failed()) {
+                _pack(object->get(properties[i]), writer, error);
+            }
+        }
+    }
+    if (!error.failed()) {
+        _pack_ext_end(writer, ext, MSGPACK_EXT_OBJECT, error);
+    }
+    _packing_objects.resize(_packing_objects.size() - 1);
+}
+
+bool Msgpack::_unpack_object(const MsgpackReader &parent, const uint8_t *data, int64_t length, Variant &value) {
+    MsgpackReader reader(data, length);
+    reader.key_cache = parent.key_cache;
+    reader.flags = parent.flags;
+    reader.depth = parent.depth + 1;
+    MsgpackError error;
+
+    Variant class_name = _unpack(reader, error);
+    Variant script_path = _unpack(reader, error);
+    Variant properties;
+    int64_t count = 0;
+    Token token = error.failed() ? TOKEN_VALUE : _unpack_token(reader, properties, count, error);
+    if (error.failed() || token != TOKEN_MAP || class_name.get_type() != Variant::STRING || (script_path.get_type() != Variant::NIL && script_path.get_type() != Variant::STRING)) {
+        return false;
+    }
+
+    // Everything is decoded and checked before the instance is created, so
+    // a failure never leaves an unowned object behind.
+    LocalVector<Variant> keys;
+    LocalVector<Variant> values;
+    for (int64_t i = 0; i < count; i++) {
+        Variant key;
+        if (reader.key_cache == nullptr || !reader.key_cache->unpack_key(reader, key)) {
+            key = _unpack(reader, error);
+        }
+        Variant property = _unpack(reader, error);
+        if (error.failed() || key.get_type() != Variant::STRING) {
+            return false;
+        }
+        keys.push_back(key);
+        values.push_back(property);
+    }
+    if (reader.get_available() != 0) {
+        return false;
+    }
+
+    Ref<Resource> script;
+    if (script_path.get_type() == Variant::STRING) {
+        script = ResourceLoader::get_singleton()->load(script_path);
+        if (script.is_null()) {
+            return false;
+        }
+    }
+    ClassDBSingleton *class_db = ClassDBSingleton::get_singleton();
+    if (!class_db->can_instantiate(class_name)) {
+        return false;
+    }
+    Variant instance = class_db->instantiate(class_name);
+    Object *object = instance;
+    if (object == nullptr) {
+        return false;
+    }
+    if (script.is_valid()) {
+        object->set_script(script);
+    }
+    for (uint32_t i = 0; i < keys.size(); i++) {
+        object->set(keys[i], values[i]);
+    }
+    value = instance;
+    return true;
+}
+
+bool Msgpack::_pack_homogeneous(const Array& array, MsgpackWriter &writer, MsgpackError &error) {
+    // Only typed arrays, checking the elements of an untyped one first
+    // costs more than the generic loop saves.
+    int64_t size = array.size();
+    if (size < 2 || !array.is_typed()) {
+        return false;
+    }
+    int64_t type = array.get_typed_builtin();
+    if (type != Variant::INT && type != Variant::FLOAT && type != Variant::STRING) {
+        return false;
+    }
+
+    MSGPACK_STATS_TYPES(pack_types, type, size);
+    bool compact = writer.flags & PACK_COMPACT_NUMBERS;
+    if (type == Variant::INT) {
+        for (int64_t i = 0; i < size; i++) {
+            if (compact) {
+                msgpack_core::write_compact_int(writer, int64_t(array[i]));
+            } else {
+                msgpack_core::write_int(writer, int64_t(array[i]));
+            }
+        }
+    } else if (type == Variant::FLOAT) {
+        for (int64_t i = 0; i < size; i++) {
+            if (compact) {
+                msgpack_core::write_compact_real(writer, double(array[i]));
+            } else {
+                msgpack_core::write_float(writer, float(array[i]));
+            }
+        }
+    } else {
+        for (int64_t i = 0; i < size && !error.failed(); i++) {
+            _pack_string(array[i].operator String(), writer, error);
+        }
+    }
+    return true;
+}
+
+bool Msgpack::_unpack_packed_array(MsgpackReader &reader, int64_t size, Variant &value) {
+    // Any element of another kind, or malformed input, fails the attempt and
+    // the caller decodes a generic Array from the start instead.
+    MsgpackReader first = reader;
+    msgpack_core::Item item;
+    msgpack_core::Result result;
+    if (!msgpack_core::read_item(first, item, result)) {
+        return false;
+    }
+
+    switch (item.kind) {
+        case msgpack_core::KIND_INT:
+        case msgpack_core::KIND_UINT: {
+            PackedInt64Array res;
+            res.resize(size);
+            int64_t *w = res.ptrw();
+            for (int64_t i = 0; i < size; i++) {
+                if (!msgpack_core::read_item(reader, item, result) || (item.kind != msgpack_core::KIND_INT && item.kind != msgpack_core::KIND_UINT)) {
+                    return false;
+                }
+                w[i] = item.integer;
+            }
+            MSGPACK_STATS_TYPES(unpack_types, Variant::INT, size);
+            value = res;
+            return true;
+        }
+        case msgpack_core::KIND_FLOAT32:
+        case msgpack_core::KIND_FLOAT64: {
+            PackedFloat64Array res;
+            res.resize(size);
+            double *w = res.ptrw();
+            for (int64_t i = 0; i < size; i++) {
+                if (!msgpack_core::read_item(reader, item, result) || (item.kind != msgpack_core::KIND_FLOAT32 && item.kind != msgpack_core::KIND_FLOAT64)) {
+                    return false;
+                }
+                w[i] = item.real;
+            }
+            MSGPACK_STATS_TYPES(unpack_types, Variant::FLOAT, size);
+            value = res;
+            return true;
+        }
+        case msgpack_core::KIND_STR: {
+            PackedStringArray res;
+            res.resize(size);
+            String *w = res.ptrw();
+            for (int64_t i = 0; i < size; i++) {
+                if (!msgpack_core::read_item(reader, item, result) || item.kind != msgpack_core::KIND_STR) {
+                    return false;
+                }
+                w[i] = _unpack_string(item.data, item.length);
+            }
+            MSGPACK_STATS_TYPES(unpack_types, Variant::STRING, size);
+            value = res;
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+void Msgpack::_pack_ext_swapped(MsgpackWriter &writer, int8_t type, const void *data, int64_t count, int64_t width, MsgpackError &error) {
+    _pack_ext_header(writer, type, count * width, error);
+    if (error.failed()) {
+        return;
+    }
+    uint8_t *dst = writer.put_space(count * width);
+    if (dst == nullptr) {
+        return;
+    }
+    if (width == 4) {
+        msgpack_copy_swap_32(dst, (const uint8_t *)data, count);
+    } else {
+        msgpack_copy_swap_64(dst, (const uint8_t *)data, count);
+    }
+}
+
+// Reads count big-endian components of width bytes into real_t storage,
+// converting when the payload was written with the other precision.
+static void _unpack_reals(real_t *dst, const uint8_t *src, int64_t count, int64_t width) {
+    if (width == int64_t(sizeof(real_t))) {
+        if (width == 4) {
+            msgpack_copy_swap_32((uint8_t *)dst, src, count);
+        } else {
+            msgpack_copy_swap_64((uint8_t *)dst, src, count);
+        }
+        return;
+    }
+    MsgpackReader reader(src, count * width);
+    for (int64_t i = 0; i < count; i++) {
+        dst[i] = width == 4 ? real_t(reader.get_float()) : real_t(reader.get_double());
+    }
+}
+
+// Reads a fixed-size math Variant stored as its real_t components, written
+// with either precision.
+static bool _unpack_math(const uint8_t *data, int64_t length, int64_t components, real_t *dst) {
+    if (length != components * 4 && length != components * 8) {
+        return false;
+    }
+    _unpack_reals(dst, data, components, length / components);
+    return true;
+}
+
+// Counts the container being decoded for as long as the scope lives.
+struct MsgpackDepthScope {
+    MsgpackReader &reader;
+
+    MsgpackDepthScope(MsgpackReader &p_reader) :
+            reader(p_reader) {
+        reader.depth++;
+    }
+
+    ~MsgpackDepthScope() {
+        reader.depth--;
+    }
+};
+
+Variant Msgpack::_unpack(MsgpackReader &reader, MsgpackError &error) {
+    int64_t start = reader.get_position();
+    Variant value;
+    int64_t size = 0;
+
+    Token token = _unpack_token(reader, value, size, error);
+    MSGPACK_STATS_TYPE(unpack_types, token == TOKEN_ARRAY ? Variant::ARRAY : (token == TOKEN_MAP ? Variant::DICTIONARY : value.get_type()));
+    if (error.failed() || token == TOKEN_VALUE) {
+        return value;
+    }
+    // Every element takes at least one byte, reject bogus sizes before
+    // allocating for them.
+    if (!reader.has(size)) {
+        error.set(Error::ERR_FILE_EOF, start, token == TOKEN_ARRAY ? "Not enough buffer for ARRAY!" : "Not enough buffer for MAP!");
+        return nullptr;
+    }
+    if (!_check_depth(reader, start, error)) {
+        return nullptr;
+    }
+    MsgpackDepthScope scope(reader);
+
+    if (token == TOKEN_ARRAY) {
+        if ((reader.flags & UNPACK_PACKED_ARRAYS) && size > 0) {
+            MsgpackReader elements = reader;
+            if (_unpack_packed_array(elements, size, value)) {
+                reader = elements;
+                return value;
+            }
         }
-        int64_t size = buffer->get_u32();
         Array res;
-        for (int i = 0; i < size; i++) {
-            res.append(_unpack(buffer, error));
-            if (int(error.get("error", Error::FAILED)) != Error::OK) {
+        res.resize(size);
+        for (int64_t i = 0; i < size; i++) {
+            res[i] = _unpack(reader, error);
+            if (error.failed()) {
                 return nullptr;
             }
         }
         return res;
-    } else if ((head & 0xF0) == MSGPACK_FORMAT_FIXMAP) {
-        int32_t size = head & 0x0f;
-        Dictionary res;
-        for (int i = 0; i < size; i++) {
-            Variant k = _unpack(buffer, error);
-            if (int(error.get("error", Error::FAILED)) != Error::OK) {
+    }
+
+    Dictionary res;
+    for (int64_t i = 0; i < size; i++) {
+        Variant k;
+        if (reader.key_cache == nullptr || !reader.key_cache->unpack_key(reader, k)) {
+            k = _unpack(reader, error);
+            if (error.failed()) {
                 return nullptr;
             }
-            Variant v = _unpack(buffer, error);
-            if (int(error.get("error", Error::FAILED)) != Error::OK) {
+        }
+        Variant v = _unpack(reader, error);
+        if (error.failed()) {
+            return nullptr;
+        }
+        res[k] = v;
+    }
+    return res;
+}
+
+Variant Msgpack::_unpack_root(MsgpackReader &reader, int64_t max_decompressed_size, MsgpackError &error) {
+    if (reader.flags & UNPACK_DECOMPRESS) {
+        int64_t start = reader.get_position();
+        PackedByteArray raw;
+        if (_decompress(reader, max_decompressed_size, raw, error)) {
+            // Decoded like the value would be without the frame, except that
+            // the frame may not hold another one.
+            MsgpackReader inner(raw.ptr(), raw.size());
+            inner.key_cache = reader.key_cache;
+            inner.flags = reader.flags & ~uint32_t(UNPACK_DECOMPRESS);
+            inner.depth = reader.depth;
+            Variant value = _unpack_root(inner, 0, error);
+            if (!error.failed() && inner.get_available() != 0) {
+                error.set(Error::ERR_INVALID_DATA, start, "Compressed frame holds more than one value!");
+            }
+            if (error.failed()) {
+                // Offsets into the decompressed bytes mean nothing to the caller.
+                error.offset = start;
                 return nullptr;
             }
-            res[k] = v;
+            return value;
         }
-        return res;
-    } else if (head == MSGPACK_FORMAT_MAP_16) {
-        if (buffer->get_size() - buffer->get_position() < 2) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for MAP16 size!";
+        if (error.failed()) {
             return nullptr;
         }
-        int32_t size = buffer->get_u16();
+    }
+    if ((reader.flags & UNPACK_PARALLEL) && !(reader.flags & UNPACK_OBJECTS) && reader.get_available() >= PARALLEL_MIN_SIZE) {
+        return _unpack_parallel(reader, error);
+    }
+    return _unpack(reader, error);
+}
+
+bool Msgpack::_decompress(MsgpackReader &reader, int64_t max_size, PackedByteArray &raw, MsgpackError &error) {
+    int64_t start = reader.get_position();
+    MsgpackReader probe = reader;
+    msgpack_core::Item item;
+    msgpack_core::Result result;
+    if (!msgpack_core::read_item(probe, item, result) || item.kind != msgpack_core::KIND_EXT || item.ext_type != MSGPACK_EXT_COMPRESSED) {
+        return false;
+    }
+    if (item.length < 5) {
+        error.set(Error::ERR_INVALID_DATA, start, "Malformed compressed frame!");
+        return false;
+    }
+    MsgpackReader header(item.data, 5);
+    int64_t mode = header.get_u8();
+    int64_t raw_size = header.get_u32();
+    if (mode > FileAccess::COMPRESSION_BROTLI) {
+        error.set(Error::ERR_INVALID_DATA, start, "Malformed compressed frame!");
+        return false;
+    }
+    if (raw_size > MIN(max_size, int64_t(MSGPACK_MAX_DECOMPRESSED_SIZE))) {
+        error.set(Error::ERR_OUT_OF_MEMORY, start, "Decompressed size above the limit!");
+        return false;
+    }
+    PackedByteArray compressed;
+    compressed.resize(item.length - 5);
+    memcpy(compressed.ptrw(), item.data + 5, item.length - 5);
+    raw = compressed.decompress(raw_size, mode);
+    if (raw.size() != raw_size) {
+        error.set(Error::ERR_INVALID_DATA, start, "Malformed compressed frame!");
+        return false;
+    }
+    reader = probe;
+    return true;
+}
+
+Variant Msgpack::_unpack_parallel(MsgpackReader &reader, MsgpackError &error) {
+    // Anything that does not split cleanly, including malformed input, is
+    // decoded sequentially from the start so results and errors match.
+    MsgpackReader start = reader;
+    msgpack_core::Item item;
+    msgpack_core::Result result;
+    if (!msgpack_core::read_item(reader, item, result) || (item.kind != msgpack_core::KIND_ARRAY && item.kind != msgpack_core::KIND_MAP) || !reader.has(item.length)) {
+        reader = start;
+        return _unpack(reader, error);
+    }
+
+    if ((reader.flags & UNPACK_PACKED_ARRAYS) && item.kind == msgpack_core::KIND_ARRAY && item.length > 0) {
+        MsgpackReader elements = reader;
+        Variant value;
+        if (_unpack_packed_array(elements, item.length, value)) {
+            reader = elements;
+            return value;
+        }
+    }
+
+    UnpackSplit split;
+    split.data = reader.peek() - reader.get_position();
+    split.size = reader.get_size();
+    split.map = item.kind == msgpack_core::KIND_MAP;
+    split.intern_keys = reader.key_cache != nullptr;
+    split.flags = reader.flags;
+    uint32_t count = uint32_t(item.length);
+    split.offsets.resize(count + 1);
+    split.chunks.push_back(0);
+    for (uint32_t i = 0; i < count; i++) {
+        split.offsets[i] = reader.get_position();
+        if (split.offsets[i] - split.offsets[split.chunks[split.chunks.size() - 1]] >= PARALLEL_CHUNK_SIZE) {
+            split.chunks.push_back(i);
+        }
+        if (!msgpack_core::skip(reader, result) || (split.map && !msgpack_core::skip(reader, result))) {
+            reader = start;
+            return _unpack(reader, error);
+        }
+    }
+    split.offsets[count] = reader.get_position();
+    split.chunks.push_back(count);
+    uint32_t chunk_count = split.chunks.size() - 1;
+    if (chunk_count < 2) {
+        reader = start;
+        return _unpack(reader, error);
+    }
+
+    MSGPACK_STATS_TYPE(unpack_types, split.map ? Variant::DICTIONARY : Variant::ARRAY);
+    if (split.map) {
+        split.keys.resize(count);
+    }
+    split.values.resize(count);
+    split.errors.resize(chunk_count);
+    WorkerThreadPool *pool = WorkerThreadPool::get_singleton();
+    int64_t group = pool->add_native_group_task(&Msgpack::_unpack_split_task, &split, chunk_count, -1, true, "Msgpack::unpack_parallel");
+    pool->wait_for_group_task_completion(group);
+
+    for (uint32_t i = 0; i < chunk_count; i++) {
+        if (split.errors[i].failed()) {
+            error = split.errors[i];
+            return nullptr;
+        }
+    }
+    if (split.map) {
         Dictionary res;
-        for (int i = 0; i < size; i++) {
-            Variant k = _unpack(buffer, error);
-            if (int(error.get("error", Error::FAILED)) != Error::OK) {
-                return nullptr;
+        for (uint32_t i = 0; i < count; i++) {
+            res[split.keys[i]] = split.values[i];
+        }
+        return res;
+    }
+    Array res;
+    res.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        res[i] = split.values[i];
+    }
+    return res;
+}
+
+Msgpack::Token Msgpack::_unpack_token(MsgpackReader &reader, Variant &value, int64_t &size, MsgpackError &error) {
+    int64_t start = reader.get_position();
+    msgpack_core::Item item;
+    msgpack_core::Result result;
+    if (!msgpack_core::read_item(reader, item, result)) {
+        error.set(result);
+        return TOKEN_VALUE;
+    }
+
+    switch (item.kind) {
+        case msgpack_core::KIND_NIL: {
+            return TOKEN_VALUE;
+        }
+        case msgpack_core::KIND_BOOL: {
+            value = item.boolean;
+            return TOKEN_VALUE;
+        }
+        case msgpack_core::KIND_INT:
+        case msgpack_core::KIND_UINT: {
+            value = item.integer;
+            return TOKEN_VALUE;
+        }
+        case msgpack_core::KIND_FLOAT32:
+        case msgpack_core::KIND_FLOAT64: {
+            value = item.real;
+            return TOKEN_VALUE;
+        }
+        case msgpack_core::KIND_STR: {
+            value = _unpack_string(item.data, item.length);
+            return TOKEN_VALUE;
+        }
+        case msgpack_core::KIND_BIN: {
+            PackedByteArray res;
+            res.resize(item.length);
+            if (item.length > 0) {
+                memcpy(res.ptrw(), item.data, item.length);
             }
-            Variant v = _unpack(buffer, error);
-            if (int(error.get("error", Error::FAILED)) != Error::OK) {
-                return nullptr;
+            value = res;
+            return TOKEN_VALUE;
+        }
+        case msgpack_core::KIND_ARRAY: {
+            size = item.length;
+            return TOKEN_ARRAY;
+        }
+        case msgpack_core::KIND_MAP: {
+            size = item.length;
+            return TOKEN_MAP;
+        }
+        case msgpack_core::KIND_EXT: {
+            if (item.ext_type == MSGPACK_EXT_COMPRESSED) {
+                error.set(Error::ERR_UNAUTHORIZED, start, "Compressed frames are only allowed at the top level with UNPACK_DECOMPRESS!");
+                return TOKEN_VALUE;
+            }
+            if (item.ext_type == MSGPACK_EXT_OBJECT) {
+                if (!(reader.flags & UNPACK_OBJECTS)) {
+                    error.set(Error::ERR_UNAUTHORIZED, start, "Objects are not allowed without UNPACK_OBJECTS!");
+                } else if (!_check_depth(reader, start, error)) {
+                    return TOKEN_VALUE;
+                } else if (!_unpack_object(reader, item.data, item.length, value)) {
+                    error.set(Error::ERR_INVALID_DATA, start, "Malformed or unknown object!");
+                }
+                return TOKEN_VALUE;
+            }
+            if (!_unpack_ext(item.ext_type, item.data, item.length, value)) {
+                error.set(Error::ERR_INVALID_DATA, start, "Unsupported or malformed ext type!");
             }
-            res[k] = v;
+            return TOKEN_VALUE;
         }
-        return res;
-    } else if (head == MSGPACK_FORMAT_MAP_32) {
-        if (buffer->get_size() - buffer->get_position() < 4) {
-            error["error"] = Error::FAILED;
-            error["error_message"] = "Not enough buffer for MAP_32 size!";
-            return nullptr;
+    }
+    return TOKEN_VALUE;
+}
+
+bool Msgpack::_check_depth(const MsgpackReader &reader, int64_t offset, MsgpackError &error) {
+    if (reader.depth < max_depth.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    error.set(Error::ERR_INVALID_DATA, offset, "Maximum nesting depth exceeded!");
+    return false;
+}
+
+void Msgpack::_skip(MsgpackReader &reader, MsgpackError &error) {
+    msgpack_core::Result result;
+    if (!msgpack_core::skip(reader, result)) {
+        error.set(result);
+    }
+}
+
+bool Msgpack::_unpack_ext(int8_t type, const uint8_t *data, int64_t length, Variant &value) {
+    switch (type) {
+        case MSGPACK_EXT_PACKED_INT32_ARRAY: {
+            if (length % 4 != 0) {
+                return false;
+            }
+            PackedInt32Array res;
+            res.resize(length / 4);
+            msgpack_copy_swap_32((uint8_t *)res.ptrw(), data, length / 4);
+            value = res;
+            return true;
         }
-        int64_t size = buffer->get_u32();
-        Dictionary res = {};
-        for (int i = 0; i < size; i++) {
-            Variant k = _unpack(buffer, error);
-            if (int(error.get("error", Error::FAILED)) != Error::OK) {
-                return nullptr;
+        case MSGPACK_EXT_PACKED_INT64_ARRAY: {
+            if (length % 8 != 0) {
+                return false;
             }
-            Variant v = _unpack(buffer, error);
-            if (int(error.get("error", Error::FAILED)) != Error::OK) {
-                return nullptr;
+            PackedInt64Array res;
+            res.resize(length / 8);
+            msgpack_copy_swap_64((uint8_t *)res.ptrw(), data, length / 8);
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_PACKED_FLOAT32_ARRAY: {
+            if (length % 4 != 0) {
+                return false;
             }
-            res[k] = v;
+            PackedFloat32Array res;
+            res.resize(length / 4);
+            msgpack_copy_swap_32((uint8_t *)res.ptrw(), data, length / 4);
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_PACKED_FLOAT64_ARRAY: {
+            if (length % 8 != 0) {
+                return false;
+            }
+            PackedFloat64Array res;
+            res.resize(length / 8);
+            msgpack_copy_swap_64((uint8_t *)res.ptrw(), data, length / 8);
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_PACKED_VECTOR2_ARRAY:
+        case MSGPACK_EXT_PACKED_VECTOR2_ARRAY_64: {
+            int64_t width = type == MSGPACK_EXT_PACKED_VECTOR2_ARRAY ? 4 : 8;
+            if (length % (width * 2) != 0) {
+                return false;
+            }
+            PackedVector2Array res;
+            res.resize(length / (width * 2));
+            _unpack_reals((real_t *)res.ptrw(), data, length / width, width);
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_PACKED_VECTOR3_ARRAY:
+        case MSGPACK_EXT_PACKED_VECTOR3_ARRAY_64: {
+            int64_t width = type == MSGPACK_EXT_PACKED_VECTOR3_ARRAY ? 4 : 8;
+            if (length % (width * 3) != 0) {
+                return false;
+            }
+            PackedVector3Array res;
+            res.resize(length / (width * 3));
+            _unpack_reals((real_t *)res.ptrw(), data, length / width, width);
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_PACKED_COLOR_ARRAY: {
+            if (length % 16 != 0) {
+                return false;
+            }
+            PackedColorArray res;
+            res.resize(length / 16);
+            msgpack_copy_swap_32((uint8_t *)res.ptrw(), data, length / 4);
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_VECTOR2: {
+            Vector2 res;
+            if (!_unpack_math(data, length, 2, (real_t *)&res)) {
+                return false;
+            }
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_VECTOR3: {
+            Vector3 res;
+            if (!_unpack_math(data, length, 3, (real_t *)&res)) {
+                return false;
+            }
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_VECTOR4: {
+            Vector4 res;
+            if (!_unpack_math(data, length, 4, (real_t *)&res)) {
+                return false;
+            }
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_QUATERNION: {
+            Quaternion res;
+            if (!_unpack_math(data, length, 4, (real_t *)&res)) {
+                return false;
+            }
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_COLOR: {
+            if (length != 16) {
+                return false;
+            }
+            Color res;
+            msgpack_copy_swap_32((uint8_t *)&res, data, 4);
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_RECT2: {
+            Rect2 res;
+            if (!_unpack_math(data, length, 4, (real_t *)&res)) {
+                return false;
+            }
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_AABB: {
+            AABB res;
+            if (!_unpack_math(data, length, 6, (real_t *)&res)) {
+                return false;
+            }
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_BASIS: {
+            Basis res;
+            if (!_unpack_math(data, length, 9, (real_t *)&res)) {
+                return false;
+            }
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_TRANSFORM3D: {
+            Transform3D res;
+            if (!_unpack_math(data, length, 12, (real_t *)&res)) {
+                return false;
+            }
+            value = res;
+            return true;
+        }
+        case MSGPACK_EXT_TIMESTAMP: {
+            int64_t seconds;
+            uint32_t nanoseconds;
+            if (!msgpack_core::read_timestamp(data, length, seconds, nanoseconds)) {
+                return false;
+            }
+            value = double(seconds) + double(nanoseconds) / 1e9;
+            return true;
+        }
+        default: {
+            return false;
         }
-        return res;
-    } else {
-        error["error"] = Error::FAILED;
-        error["error_message"] = "Invalid byte tag!";
-        return nullptr;
     }
 }
@@ -2,11 +2,24 @@
 #define MSGPACK_HPP
 
 #include "msgpack_common.hpp"
+#include "msgpack_error.hpp"
+#include "msgpack_key_cache.hpp"
+#include "msgpack_name_cache.hpp"
+#include "msgpack_object_cache.hpp"
+#include "msgpack_reader.hpp"
+#include "msgpack_stats.hpp"
+#include "msgpack_writer.hpp"
 
 #include <godot_cpp/classes/ref_counted.hpp>
-#include <godot_cpp/classes/stream_peer_buffer.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+#include <godot_cpp/variant/typed_array.hpp>
+
+#include <atomic>
 
 namespace godot {
+    class MsgpackEncoder;
+
     class Msgpack : public RefCounted {
         GDCLASS(Msgpack, RefCounted)
 
@@ -14,20 +27,217 @@ namespace godot {
         Msgpack();
         ~Msgpack() override;
 
+        enum PackFlags {
+            // Smallest integer form including unsigned ones, FLOAT_64 for
+            // floats that do not survive narrowing to FLOAT_32.
+            PACK_COMPACT_NUMBERS = 1,
+            // Wrap the result in a compressed frame when it is at least
+            // compression_threshold bytes and compressing makes it smaller.
+            PACK_COMPRESS = 2,
+            // Objects as their class, script path and storage properties.
+            // Objects are only read on the calling thread, pack_batch packs
+            // sequentially with it and pack_async refuses it.
+            PACK_OBJECTS = 4,
+        };
+
+        enum UnpackFlags {
+            // Instantiate objects packed with PACK_OBJECTS. Off by default,
+            // since it lets the input create instances of any class. Like
+            // PACK_OBJECTS it keeps decoding on the calling thread.
+            UNPACK_OBJECTS = 1,
+            // Decode the elements of a large top-level array or map on the
+            // WorkerThreadPool. Ignored by unpack_batch and unpack_async.
+            UNPACK_PARALLEL = 2,
+            // Arrays holding only ints, only floats or only strings become
+            // PackedInt64Array, PackedFloat64Array or PackedStringArray.
+            UNPACK_PACKED_ARRAYS = 4,
+            // Accept a top-level value packed with PACK_COMPRESS. Off by
+            // default, since a small frame can ask for a large allocation.
+            // Compressed frames below the top level are always rejected.
+            UNPACK_DECOMPRESS = 8,
+        };
+
         static Msgpack *get_singleton();
 
-        PackedByteArray pack(const Variant& data);
-        Variant unpack(const PackedByteArray& data);
+        PackedByteArray pack(const Variant& data, BitField<PackFlags> flags = 0);
+        Variant unpack(const PackedByteArray& data, BitField<UnpackFlags> flags = 0, int64_t max_decompressed_size = MSGPACK_MAX_DECOMPRESSED_SIZE);
+        Dictionary pack_checked(const Variant& data, BitField<PackFlags> flags = 0);
+        Dictionary unpack_checked(const PackedByteArray& data, BitField<UnpackFlags> flags = 0, int64_t max_decompressed_size = MSGPACK_MAX_DECOMPRESSED_SIZE);
+        int64_t pack_into(const Variant& data, const Ref<MsgpackEncoder>& encoder, int64_t offset);
+        Dictionary unpack_from(const PackedByteArray& data, int64_t offset, BitField<UnpackFlags> flags = 0, int64_t max_decompressed_size = MSGPACK_MAX_DECOMPRESSED_SIZE);
+        TypedArray<PackedByteArray> pack_batch(const Array& data, BitField<PackFlags> flags = 0);
+        Array unpack_batch(const TypedArray<PackedByteArray>& data, BitField<UnpackFlags> flags = 0, int64_t max_decompressed_size = MSGPACK_MAX_DECOMPRESSED_SIZE);
+        PackedByteArray pack_delta(const Variant& previous, const Variant& current, BitField<PackFlags> flags = 0);
+        Variant apply_delta(const Variant& previous, const PackedByteArray& patch);
+        PackedByteArray pack_timestamp(double unix_time);
+        int64_t pack_async(const Variant& data, const Callable& callback = Callable(), BitField<PackFlags> flags = 0);
+        int64_t unpack_async(const PackedByteArray& data, const Callable& callback = Callable(), BitField<UnpackFlags> flags = 0, int64_t max_decompressed_size = MSGPACK_MAX_DECOMPRESSED_SIZE);
+        bool cancel_async(int64_t task_id);
+        void set_intern_keys(bool p_enabled);
+        bool is_intern_keys() const;
+        void clear_key_cache();
+        void set_compression_mode(int p_mode);
+        int get_compression_mode() const;
+        void set_compression_threshold(int64_t p_threshold);
+        int64_t get_compression_threshold() const;
+        void set_max_depth(int64_t p_depth);
+        int64_t get_max_depth() const;
+        void set_stats_enabled(bool p_enabled);
+        bool is_stats_enabled() const;
+        Dictionary get_stats() const;
+        void reset_stats();
+
+        static MsgpackStats stats;
+        // Read by worker threads packing with PACK_COMPRESS.
+        static std::atomic<int> compression_mode;
+        static std::atomic<int64_t> compression_threshold;
+        static std::atomic<int64_t> max_depth;
+
+        // Codec internals shared with the other Msgpack* classes.
+        enum Token {
+            TOKEN_VALUE,
+            TOKEN_ARRAY,
+            TOKEN_MAP,
+        };
+
+        static int64_t _estimate_size(const Variant& data, int64_t depth = 0);
+        static void _pack(const Variant& data, MsgpackWriter &writer, MsgpackError &error);
+        static Variant _unpack(MsgpackReader &reader, MsgpackError &error);
+        // Reads one value header. Scalars are decoded into value, containers
+        // return their element count in size and leave the elements unread.
+        // Truncated input fails with ERR_FILE_EOF.
+        static Token _unpack_token(MsgpackReader &reader, Variant &value, int64_t &size, MsgpackError &error);
+        // Advances the reader past one complete value without decoding it.
+        static void _skip(MsgpackReader &reader, MsgpackError &error);
+        static void _pack_array_header(MsgpackWriter &writer, int64_t size, MsgpackError &error);
+        static void _pack_map_header(MsgpackWriter &writer, int64_t size, MsgpackError &error);
+        static void _pack_ext_header(MsgpackWriter &writer, int8_t type, int64_t length, MsgpackError &error);
+        static void _pack_string(const String& string, MsgpackWriter &writer, MsgpackError &error);
+        // Decodes UTF-8 straight into the String storage, input it cannot
+        // take exactly goes through String::utf8.
+        static String _unpack_string(const uint8_t *data, int64_t length);
+        // Packs a Unix time in seconds as the standard timestamp ext.
+        static void _pack_timestamp(MsgpackWriter &writer, double unix_time, MsgpackError &error);
+        // For ext values whose length is not known up front: reserves room for
+        // the largest header and returns its offset, _pack_ext_end then writes
+        // the smallest fitting header and moves the payload down to it.
+        static int64_t _pack_ext_begin(MsgpackWriter &writer);
+        static void _pack_ext_end(MsgpackWriter &writer, int64_t offset, int8_t type, MsgpackError &error);
+        // Decodes an application ext payload. Returns false for unknown types
+        // and malformed payloads.
+        static bool _unpack_ext(int8_t type, const uint8_t *data, int64_t length, Variant &value);
+        // Fails with an error at offset when the reader is already max_depth
+        // levels deep, so hostile input cannot exhaust the stack.
+        static bool _check_depth(const MsgpackReader &reader, int64_t offset, MsgpackError &error);
+        static void _print_error(const MsgpackError &error);
 
     protected:
         static void _bind_methods();
 
     private:
+        struct PackBatch {
+            LocalVector<Variant> inputs;
+            LocalVector<PackedByteArray> outputs;
+            LocalVector<MsgpackError> errors;
+            uint32_t flags = 0;
+        };
+
+        // Top-level container split into chunks of consecutive elements,
+        // element i (a key / value pair for maps) starts at offsets[i].
+        struct UnpackSplit {
+            const uint8_t *data = nullptr;
+            int64_t size = 0;
+            bool map = false;
+            LocalVector<int64_t> offsets;
+            // Chunk i covers the elements chunks[i]..chunks[i + 1].
+            LocalVector<uint32_t> chunks;
+            LocalVector<Variant> keys;
+            LocalVector<Variant> values;
+            LocalVector<MsgpackError> errors;
+            bool intern_keys = false;
+            uint32_t flags = 0;
+        };
+
+        // Inputs below this size are not worth splitting, chunks are cut once
+        // they reach the chunk size.
+        static constexpr int64_t PARALLEL_MIN_SIZE = 256 * 1024;
+        static constexpr int64_t PARALLEL_CHUNK_SIZE = 64 * 1024;
+
+        struct UnpackBatch {
+            LocalVector<PackedByteArray> inputs;
+            LocalVector<Variant> outputs;
+            LocalVector<MsgpackError> errors;
+            bool intern_keys = false;
+            uint32_t flags = 0;
+            int64_t max_decompressed_size = 0;
+        };
+
+        // Owned by the main thread. Workers only see their own task and hand
+        // it back through a deferred call.
+        struct AsyncTask {
+            int64_t id = 0;
+            int64_t pool_task = 0;
+            bool unpack = false;
+            uint32_t flags = 0;
+            int64_t max_decompressed_size = 0;
+            std::atomic<bool> cancelled = { false };
+            Variant input;
+            Variant output;
+            MsgpackError error;
+            Callable callback;
+            bool intern_keys = false;
+        };
+
         static Msgpack *msgpack;
 
-        void _pack(const Variant& data, StreamPeerBuffer *buffer, Dictionary &error);
-        Variant _unpack(StreamPeerBuffer *buffer, Dictionary &error);
+        HashMap<int64_t, AsyncTask *> async_tasks;
+        int64_t next_async_id = 1;
+        bool intern_keys = false;
+
+        _FORCE_INLINE_ MsgpackKeyCache *_get_key_cache() {
+            return intern_keys ? MsgpackKeyCache::get_thread_cache() : nullptr;
+        }
+
+        bool monitors_added = false;
+
+        void _add_monitors();
+        void _remove_monitors();
+        Variant _get_monitor(int64_t index) const;
+
+        int64_t _start_async(const Variant& data, bool unpack, const Callable& callback, uint32_t flags, int64_t max_decompressed_size);
+        void _async_finished(int64_t task_id);
+        static void _async_task(void *userdata);
+
+        static void _pack_batch_task(void *userdata, uint32_t index);
+        static void _unpack_batch_task(void *userdata, uint32_t index);
+        static void _unpack_split_task(void *userdata, uint32_t index);
+
+        // Entry point of the top-level unpack calls, applies UNPACK_DECOMPRESS
+        // and UNPACK_PARALLEL.
+        static Variant _unpack_root(MsgpackReader &reader, int64_t max_decompressed_size, MsgpackError &error);
+        // Decompresses the frame at the reader position into raw. Returns
+        // false, without consuming anything, if the next value is not a
+        // compressed frame or the frame is refused.
+        static bool _decompress(MsgpackReader &reader, int64_t max_size, PackedByteArray &raw, MsgpackError &error);
+        static Variant _unpack_parallel(MsgpackReader &reader, MsgpackError &error);
+
+        static PackedByteArray _finish(MsgpackWriter &writer, const MsgpackError &error);
+        static PackedByteArray _compress(const PackedByteArray& packed);
+        static Dictionary _make_result(const Variant& result, const MsgpackError &error);
+        static bool _pack_delta(const Variant& previous, const Variant& current, MsgpackWriter &writer, MsgpackError &error, bool root);
+        static Variant _apply_delta(const Variant& previous, MsgpackReader &reader, MsgpackError &error);
+        static void _pack_object(Object *object, MsgpackWriter &writer, MsgpackError &error);
+        static bool _unpack_object(const MsgpackReader &parent, const uint8_t *data, int64_t length, Variant &value);
+        // Element loops without per-value dispatch for typed int, float and
+        // String arrays. Return false, without writing or consuming anything,
+        // for other arrays.
+        static bool _pack_homogeneous(const Array& array, MsgpackWriter &writer, MsgpackError &error);
+        static bool _unpack_packed_array(MsgpackReader &reader, int64_t size, Variant &value);
+        static void _pack_ext_swapped(MsgpackWriter &writer, int8_t type, const void *data, int64_t count, int64_t width, MsgpackError &error);
     };
 }
 
+VARIANT_BITFIELD_CAST(Msgpack::PackFlags);
+VARIANT_BITFIELD_CAST(Msgpack::UnpackFlags);
+
 #endif //MSGPACK_HPP
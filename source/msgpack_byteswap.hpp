@@ -0,0 +1,89 @@
+#ifndef MSGPACK_BYTESWAP_HPP
+#define MSGPACK_BYTESWAP_HPP
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MSGPACK_SIMD_SSE2
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#define MSGPACK_SIMD_SSSE3
+#include <tmmintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define MSGPACK_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <cstdlib>
+#define MSGPACK_BSWAP32(x) _byteswap_ulong(x)
+#define MSGPACK_BSWAP64(x) _byteswap_uint64(x)
+#else
+#define MSGPACK_BSWAP32(x) __builtin_bswap32(x)
+#define MSGPACK_BSWAP64(x) __builtin_bswap64(x)
+#endif
+
+// Copy p_count 32 or 64-bit elements from p_src to p_dst while converting
+// them between host (little-endian) and network (big-endian) byte order.
+// Neither pointer needs to be aligned and the conversion is its own inverse,
+// so the same routines serve the encoder and the decoder.
+
+static inline void msgpack_copy_swap_32(uint8_t *p_dst, const uint8_t *p_src, int64_t p_count) {
+    int64_t i = 0;
+#if defined(MSGPACK_SIMD_SSSE3)
+    const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for (; i + 4 <= p_count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p_src + i * 4));
+        _mm_storeu_si128((__m128i *)(p_dst + i * 4), _mm_shuffle_epi8(v, mask));
+    }
+#elif defined(MSGPACK_SIMD_SSE2)
+    for (; i + 4 <= p_count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p_src + i * 4));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(p_dst + i * 4), v);
+    }
+#elif defined(MSGPACK_SIMD_NEON)
+    for (; i + 4 <= p_count; i += 4) {
+        vst1q_u8(p_dst + i * 4, vrev32q_u8(vld1q_u8(p_src + i * 4)));
+    }
+#endif
+    for (; i < p_count; i++) {
+        uint32_t v;
+        memcpy(&v, p_src + i * 4, 4);
+        v = MSGPACK_BSWAP32(v);
+        memcpy(p_dst + i * 4, &v, 4);
+    }
+}
+
+static inline void msgpack_copy_swap_64(uint8_t *p_dst, const uint8_t *p_src, int64_t p_count) {
+    int64_t i = 0;
+#if defined(MSGPACK_SIMD_SSSE3)
+    const __m128i mask = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+    for (; i + 2 <= p_count; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p_src + i * 8));
+        _mm_storeu_si128((__m128i *)(p_dst + i * 8), _mm_shuffle_epi8(v, mask));
+    }
+#elif defined(MSGPACK_SIMD_SSE2)
+    for (; i + 2 <= p_count; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p_src + i * 8));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(p_dst + i * 8), v);
+    }
+#elif defined(MSGPACK_SIMD_NEON)
+    for (; i + 2 <= p_count; i += 2) {
+        vst1q_u8(p_dst + i * 8, vrev64q_u8(vld1q_u8(p_src + i * 8)));
+    }
+#endif
+    for (; i < p_count; i++) {
+        uint64_t v;
+        memcpy(&v, p_src + i * 8, 8);
+        v = MSGPACK_BSWAP64(v);
+        memcpy(p_dst + i * 8, &v, 8);
+    }
+}
+
+#endif //MSGPACK_BYTESWAP_HPP
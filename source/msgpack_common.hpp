@@ -39,4 +39,53 @@
 #define MSGPACK_FORMAT_MAP_32          0xDF
 #define MSGPACK_FORMAT_NEGATIVE_FIXINT 0xE0
 
+// Application ext types used for Godot Variants without a msgpack equivalent.
+// Payloads hold raw big-endian elements. Real-valued vector arrays carry the
+// component width in the type, _64 variants come from double precision builds.
+#define MSGPACK_EXT_PACKED_INT32_ARRAY      0x01
+#define MSGPACK_EXT_PACKED_INT64_ARRAY      0x02
+#define MSGPACK_EXT_PACKED_FLOAT32_ARRAY    0x03
+#define MSGPACK_EXT_PACKED_FLOAT64_ARRAY    0x04
+#define MSGPACK_EXT_PACKED_VECTOR2_ARRAY    0x05
+#define MSGPACK_EXT_PACKED_VECTOR3_ARRAY    0x06
+#define MSGPACK_EXT_PACKED_COLOR_ARRAY      0x07
+#define MSGPACK_EXT_PACKED_VECTOR2_ARRAY_64 0x08
+#define MSGPACK_EXT_PACKED_VECTOR3_ARRAY_64 0x09
+
+// Fixed-size math Variants, packed as their big-endian real_t components.
+// The component width follows from the payload size.
+#define MSGPACK_EXT_VECTOR2                 0x10
+#define MSGPACK_EXT_VECTOR3                 0x11
+#define MSGPACK_EXT_VECTOR4                 0x12
+#define MSGPACK_EXT_QUATERNION              0x13
+#define MSGPACK_EXT_COLOR                   0x14
+#define MSGPACK_EXT_RECT2                   0x15
+#define MSGPACK_EXT_AABB                    0x16
+#define MSGPACK_EXT_BASIS                   0x17
+#define MSGPACK_EXT_TRANSFORM3D             0x18
+
+// Patches produced by Msgpack.pack_delta. A DELTA_MAP payload is a sequence
+// of key / patch pairs, a DELTA_ARRAY payload the new size followed by
+// index / patch pairs. A plain value as patch replaces the previous one.
+#define MSGPACK_EXT_DELTA_MAP               0x20
+#define MSGPACK_EXT_DELTA_ARRAY             0x21
+#define MSGPACK_EXT_DELTA_REMOVE            0x22
+
+// Compressed frame: [u8 FileAccess.CompressionMode][u32 raw size][data], the
+// raw bytes hold one packed value. Only decoded as the top-level value with
+// Msgpack.UNPACK_DECOMPRESS, and never for raw sizes above the cap.
+#define MSGPACK_EXT_COMPRESSED              0x23
+#define MSGPACK_MAX_DECOMPRESSED_SIZE       (256 * 1024 * 1024)
+
+// Object packed with PACK_OBJECTS: class name string, script path string or
+// nil, then a map of storage property names to values.
+#define MSGPACK_EXT_OBJECT                  0x24
+
+// Default for Msgpack.max_depth, the deepest nesting of arrays, maps and
+// objects the decoder follows before failing.
+#define MSGPACK_DEFAULT_MAX_DEPTH           512
+
+// Timestamp ext reserved by the msgpack spec, 32, 64 or 96 bit payload.
+#define MSGPACK_EXT_TIMESTAMP               -1
+
 #endif //MSGPACK_COMMON_HPP
@@ -0,0 +1,629 @@
+#ifndef MSGPACK_CORE_HPP
+#define MSGPACK_CORE_HPP
+
+#include "msgpack_common.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Wire-format encoding and decoding without any engine types, shared by the
+// Godot binding and the native benchmark and fuzz tools.
+//
+// Writers are templated over a sink providing put_u8/u16/u32/u64, put_float,
+// put_double and put_data. Readers are templated over a source providing
+// get_position, has, peek, get_u8/u16/u32/u64, get_float, get_double and
+// get_data, like BufferReader below.
+namespace msgpack_core {
+    enum Status {
+        STATUS_OK,
+        STATUS_TRUNCATED,
+        STATUS_INVALID,
+        STATUS_TOO_LARGE,
+    };
+
+    struct Result {
+        Status status = STATUS_OK;
+        int64_t offset = 0;
+        const char *message = "";
+
+        bool failed() const {
+            return status != STATUS_OK;
+        }
+
+        void set(Status p_status, int64_t p_offset, const char *p_message) {
+            status = p_status;
+            offset = p_offset;
+            message = p_message;
+        }
+    };
+
+    enum Kind {
+        KIND_NIL,
+        KIND_BOOL,
+        KIND_INT,
+        KIND_UINT,
+        KIND_FLOAT32,
+        KIND_FLOAT64,
+        KIND_STR,
+        KIND_BIN,
+        KIND_ARRAY,
+        KIND_MAP,
+        KIND_EXT,
+    };
+
+    // One decoded value header. Payloads point into the source buffer.
+    struct Item {
+        Kind kind = KIND_NIL;
+        bool boolean = false;
+        // KIND_INT and KIND_UINT, unsigned values are stored as their bits.
+        int64_t integer = 0;
+        double real = 0.0;
+        const uint8_t *data = nullptr;
+        // Payload bytes of STR, BIN and EXT, element count of ARRAY and MAP.
+        int64_t length = 0;
+        int8_t ext_type = 0;
+    };
+
+    // Big-endian cursor over a borrowed byte range. Loads do not check bounds,
+    // callers test has() first.
+    class BufferReader {
+    public:
+        BufferReader(const uint8_t *p_data, int64_t p_size) :
+                data(p_data), size(p_size) {}
+
+        inline int64_t get_position() const {
+            return position;
+        }
+
+        inline int64_t get_size() const {
+            return size;
+        }
+
+        inline int64_t get_available() const {
+            return size - position;
+        }
+
+        inline bool has(int64_t p_bytes) const {
+            return size - position >= p_bytes;
+        }
+
+        inline uint8_t get_u8() {
+            return data[position++];
+        }
+
+        inline uint16_t get_u16() {
+            uint16_t value = (uint16_t(data[position]) << 8) | uint16_t(data[position + 1]);
+            position += 2;
+            return value;
+        }
+
+        inline uint32_t get_u32() {
+            const uint8_t *p = data + position;
+            uint32_t value = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+            position += 4;
+            return value;
+        }
+
+        inline uint64_t get_u64() {
+            uint64_t high = get_u32();
+            return (high << 32) | get_u32();
+        }
+
+        inline float get_float() {
+            uint32_t bits = get_u32();
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        inline double get_double() {
+            uint64_t bits = get_u64();
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        inline const uint8_t *peek() const {
+            return data + position;
+        }
+
+        // Returns a pointer to the next p_bytes bytes and skips over them.
+        inline const uint8_t *get_data(int64_t p_bytes) {
+            const uint8_t *p = data + position;
+            position += p_bytes;
+            return p;
+        }
+
+    private:
+        const uint8_t *data = nullptr;
+        int64_t size = 0;
+        int64_t position = 0;
+    };
+
+    // Growable sink on top of std::vector, for use outside the engine.
+    class VectorWriter {
+    public:
+        std::vector<uint8_t> buffer;
+
+        inline void put_u8(uint8_t p_value) {
+            buffer.push_back(p_value);
+        }
+
+        inline void put_u16(uint16_t p_value) {
+            uint8_t bytes[2] = { uint8_t(p_value >> 8), uint8_t(p_value) };
+            buffer.insert(buffer.end(), bytes, bytes + 2);
+        }
+
+        inline void put_u32(uint32_t p_value) {
+            uint8_t bytes[4] = { uint8_t(p_value >> 24), uint8_t(p_value >> 16), uint8_t(p_value >> 8), uint8_t(p_value) };
+            buffer.insert(buffer.end(), bytes, bytes + 4);
+        }
+
+        inline void put_u64(uint64_t p_value) {
+            put_u32(uint32_t(p_value >> 32));
+            put_u32(uint32_t(p_value));
+        }
+
+        inline void put_float(float p_value) {
+            uint32_t bits;
+            memcpy(&bits, &p_value, sizeof(bits));
+            put_u32(bits);
+        }
+
+        inline void put_double(double p_value) {
+            uint64_t bits;
+            memcpy(&bits, &p_value, sizeof(bits));
+            put_u64(bits);
+        }
+
+        inline void put_data(const uint8_t *p_data, int64_t p_size) {
+            buffer.insert(buffer.end(), p_data, p_data + p_size);
+        }
+
+        inline int64_t get_size() const {
+            return int64_t(buffer.size());
+        }
+    };
+
+    template <class Sink>
+    inline void write_nil(Sink &sink) {
+        sink.put_u8(MSGPACK_FORMAT_NIL);
+    }
+
+    template <class Sink>
+    inline void write_bool(Sink &sink, bool value) {
+        sink.put_u8(value ? MSGPACK_FORMAT_TRUE : MSGPACK_FORMAT_FALSE);
+    }
+
+    // Smallest signed form holding the value.
+    template <class Sink>
+    inline void write_int(Sink &sink, int64_t value) {
+        if (-(1 << 5) <= value && value <= (1 << 7) - 1) {
+            sink.put_u8(uint8_t(value));
+        } else if (-(1 << 7) <= value && value <= (1 << 7) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_INT_8);
+            sink.put_u8(uint8_t(value));
+        } else if (-(1 << 15) <= value && value <= (1 << 15) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_INT_16);
+            sink.put_u16(uint16_t(value));
+        } else if (-(int64_t(1) << 31) <= value && value <= (int64_t(1) << 31) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_INT_32);
+            sink.put_u32(uint32_t(value));
+        } else {
+            sink.put_u8(MSGPACK_FORMAT_INT_64);
+            sink.put_u64(uint64_t(value));
+        }
+    }
+
+    template <class Sink>
+    inline void write_uint(Sink &sink, uint64_t value) {
+        if (value <= 0x7f) {
+            sink.put_u8(uint8_t(value));
+        } else if (value <= 0xff) {
+            sink.put_u8(MSGPACK_FORMAT_UINT_8);
+            sink.put_u8(uint8_t(value));
+        } else if (value <= 0xffff) {
+            sink.put_u8(MSGPACK_FORMAT_UINT_16);
+            sink.put_u16(uint16_t(value));
+        } else if (value <= 0xffffffff) {
+            sink.put_u8(MSGPACK_FORMAT_UINT_32);
+            sink.put_u32(uint32_t(value));
+        } else {
+            sink.put_u8(MSGPACK_FORMAT_UINT_64);
+            sink.put_u64(value);
+        }
+    }
+
+    template <class Sink>
+    inline void write_float(Sink &sink, float value) {
+        sink.put_u8(MSGPACK_FORMAT_FLOAT_32);
+        sink.put_float(value);
+    }
+
+    template <class Sink>
+    inline void write_double(Sink &sink, double value) {
+        sink.put_u8(MSGPACK_FORMAT_FLOAT_64);
+        sink.put_double(value);
+    }
+
+    // Smallest form that decodes back to the same value: unsigned forms for
+    // non-negative integers, FLOAT_32 only when the value survives narrowing.
+    template <class Sink>
+    inline void write_compact_int(Sink &sink, int64_t value) {
+        if (value >= 0) {
+            write_uint(sink, uint64_t(value));
+        } else {
+            write_int(sink, value);
+        }
+    }
+
+    template <class Sink>
+    inline void write_compact_real(Sink &sink, double value) {
+        // NaN and infinities narrow exactly, finite values outside the float
+        // range must not be converted at all.
+        bool fits = std::isnan(value) || std::isinf(value) || (std::fabs(value) <= FLT_MAX && double(float(value)) == value);
+        if (fits) {
+            write_float(sink, float(value));
+        } else {
+            write_double(sink, value);
+        }
+    }
+
+    // Header writers return false if the length does not fit the format.
+    template <class Sink>
+    inline bool write_str_header(Sink &sink, int64_t length) {
+        if (length <= (1 << 5) - 1) {
+            sink.put_u8(uint8_t(MSGPACK_FORMAT_FIXSTR | length));
+        } else if (length <= (1 << 8) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_STR_8);
+            sink.put_u8(uint8_t(length));
+        } else if (length <= (1 << 16) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_STR_16);
+            sink.put_u16(uint16_t(length));
+        } else if (length <= (int64_t(1) << 32) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_STR_32);
+            sink.put_u32(uint32_t(length));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    template <class Sink>
+    inline bool write_bin_header(Sink &sink, int64_t length) {
+        if (length <= (1 << 8) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_BIN_8);
+            sink.put_u8(uint8_t(length));
+        } else if (length <= (1 << 16) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_BIN_16);
+            sink.put_u16(uint16_t(length));
+        } else if (length <= (int64_t(1) << 32) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_BIN_32);
+            sink.put_u32(uint32_t(length));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    template <class Sink>
+    inline bool write_array_header(Sink &sink, int64_t size) {
+        if (size <= 15) {
+            sink.put_u8(uint8_t(MSGPACK_FORMAT_FIXARRAY | size));
+        } else if (size <= (1 << 16) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_ARRAY_16);
+            sink.put_u16(uint16_t(size));
+        } else if (size <= (int64_t(1) << 32) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_ARRAY_32);
+            sink.put_u32(uint32_t(size));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    template <class Sink>
+    inline bool write_map_header(Sink &sink, int64_t size) {
+        if (size <= 15) {
+            sink.put_u8(uint8_t(MSGPACK_FORMAT_FIXMAP | size));
+        } else if (size <= (1 << 16) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_MAP_16);
+            sink.put_u16(uint16_t(size));
+        } else if (size <= (int64_t(1) << 32) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_MAP_32);
+            sink.put_u32(uint32_t(size));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    template <class Sink>
+    inline bool write_ext_header(Sink &sink, int8_t type, int64_t length) {
+        if (length == 1) {
+            sink.put_u8(MSGPACK_FORMAT_FIXEXT_1);
+        } else if (length == 2) {
+            sink.put_u8(MSGPACK_FORMAT_FIXEXT_2);
+        } else if (length == 4) {
+            sink.put_u8(MSGPACK_FORMAT_FIXEXT_4);
+        } else if (length == 8) {
+            sink.put_u8(MSGPACK_FORMAT_FIXEXT_8);
+        } else if (length == 16) {
+            sink.put_u8(MSGPACK_FORMAT_FIXEXT_16);
+        } else if (length <= (1 << 8) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_EXT_8);
+            sink.put_u8(uint8_t(length));
+        } else if (length <= (1 << 16) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_EXT_16);
+            sink.put_u16(uint16_t(length));
+        } else if (length <= (int64_t(1) << 32) - 1) {
+            sink.put_u8(MSGPACK_FORMAT_EXT_32);
+            sink.put_u32(uint32_t(length));
+        } else {
+            return false;
+        }
+        sink.put_u8(uint8_t(type));
+        return true;
+    }
+
+    template <class Sink>
+    inline bool write_str(Sink &sink, const char *data, int64_t length) {
+        if (!write_str_header(sink, length)) {
+            return false;
+        }
+        sink.put_data((const uint8_t *)data, length);
+        return true;
+    }
+
+    template <class Sink>
+    inline bool write_bin(Sink &sink, const uint8_t *data, int64_t length) {
+        if (!write_bin_header(sink, length)) {
+            return false;
+        }
+        sink.put_data(data, length);
+        return true;
+    }
+
+    // Standard timestamp ext in its smallest form: 32 bit seconds, 30 bit
+    // nanoseconds with 34 bit seconds, or 32 bit nanoseconds with 64 bit
+    // signed seconds.
+    template <class Sink>
+    inline void write_timestamp(Sink &sink, int64_t seconds, uint32_t nanoseconds) {
+        if ((seconds >> 34) == 0) {
+            uint64_t packed = (uint64_t(nanoseconds) << 34) | uint64_t(seconds);
+            if ((packed >> 32) == 0) {
+                write_ext_header(sink, MSGPACK_EXT_TIMESTAMP, 4);
+                sink.put_u32(uint32_t(packed));
+            } else {
+                write_ext_header(sink, MSGPACK_EXT_TIMESTAMP, 8);
+                sink.put_u64(packed);
+            }
+        } else {
+            write_ext_header(sink, MSGPACK_EXT_TIMESTAMP, 12);
+            sink.put_u32(nanoseconds);
+            sink.put_u64(uint64_t(seconds));
+        }
+    }
+
+    // Decodes a timestamp ext payload. Returns false for other payload sizes
+    // and nanoseconds out of range.
+    inline bool read_timestamp(const uint8_t *data, int64_t length, int64_t &seconds, uint32_t &nanoseconds) {
+        BufferReader reader(data, length);
+        if (length == 4) {
+            seconds = reader.get_u32();
+            nanoseconds = 0;
+        } else if (length == 8) {
+            uint64_t packed = reader.get_u64();
+            seconds = int64_t(packed & ((uint64_t(1) << 34) - 1));
+            nanoseconds = uint32_t(packed >> 34);
+        } else if (length == 12) {
+            nanoseconds = reader.get_u32();
+            seconds = int64_t(reader.get_u64());
+        } else {
+            return false;
+        }
+        return nanoseconds < 1000000000;
+    }
+
+    // Reads a length field of p_bytes bytes following the format byte.
+    template <class Source>
+    inline bool _read_length(Source &source, int p_bytes, int64_t &length, int64_t start, Result &result) {
+        if (!source.has(p_bytes)) {
+            result.set(STATUS_TRUNCATED, start, "Not enough buffer for size!");
+            return false;
+        }
+        length = p_bytes == 1 ? source.get_u8() : (p_bytes == 2 ? source.get_u16() : source.get_u32());
+        return true;
+    }
+
+    // Reads one value header. Scalars are decoded completely, STR, BIN and
+    // EXT payloads are bounds checked and referenced in place, containers
+    // return their element count and leave the elements unread.
+    template <class Source>
+    bool read_item(Source &source, Item &item, Result &result) {
+        int64_t start = source.get_position();
+        if (!source.has(1)) {
+            result.set(STATUS_TRUNCATED, start, "Unexpected end of input!");
+            return false;
+        }
+        uint8_t head = source.get_u8();
+        int64_t length = 0;
+        int scalar = 0;
+
+        if (head <= 0x7f) {
+            item.kind = KIND_INT;
+            item.integer = head;
+            return true;
+        } else if (head >= MSGPACK_FORMAT_NEGATIVE_FIXINT) {
+            item.kind = KIND_INT;
+            item.integer = int64_t(head) - 256;
+            return true;
+        } else if ((head & 0xF0) == MSGPACK_FORMAT_FIXMAP) {
+            item.kind = KIND_MAP;
+            item.length = head & 0x0f;
+            return true;
+        } else if ((head & 0xF0) == MSGPACK_FORMAT_FIXARRAY) {
+            item.kind = KIND_ARRAY;
+            item.length = head & 0x0f;
+            return true;
+        } else if ((head & 0xE0) == MSGPACK_FORMAT_FIXSTR) {
+            item.kind = KIND_STR;
+            length = head & 0x1f;
+        } else {
+            switch (head) {
+                case MSGPACK_FORMAT_NIL:
+                    item.kind = KIND_NIL;
+                    return true;
+                case MSGPACK_FORMAT_FALSE:
+                case MSGPACK_FORMAT_TRUE:
+                    item.kind = KIND_BOOL;
+                    item.boolean = head == MSGPACK_FORMAT_TRUE;
+                    return true;
+                case MSGPACK_FORMAT_UINT_8:
+                case MSGPACK_FORMAT_UINT_16:
+                case MSGPACK_FORMAT_UINT_32:
+                case MSGPACK_FORMAT_UINT_64:
+                    item.kind = KIND_UINT;
+                    scalar = 1 << (head - MSGPACK_FORMAT_UINT_8);
+                    break;
+                case MSGPACK_FORMAT_INT_8:
+                case MSGPACK_FORMAT_INT_16:
+                case MSGPACK_FORMAT_INT_32:
+                case MSGPACK_FORMAT_INT_64:
+                    item.kind = KIND_INT;
+                    scalar = 1 << (head - MSGPACK_FORMAT_INT_8);
+                    break;
+                case MSGPACK_FORMAT_FLOAT_32:
+                    item.kind = KIND_FLOAT32;
+                    scalar = 4;
+                    break;
+                case MSGPACK_FORMAT_FLOAT_64:
+                    item.kind = KIND_FLOAT64;
+                    scalar = 8;
+                    break;
+                case MSGPACK_FORMAT_STR_8:
+                case MSGPACK_FORMAT_STR_16:
+                case MSGPACK_FORMAT_STR_32:
+                    item.kind = KIND_STR;
+                    if (!_read_length(source, 1 << (head - MSGPACK_FORMAT_STR_8), length, start, result)) {
+                        return false;
+                    }
+                    break;
+                case MSGPACK_FORMAT_BIN_8:
+                case MSGPACK_FORMAT_BIN_16:
+                case MSGPACK_FORMAT_BIN_32:
+                    item.kind = KIND_BIN;
+                    if (!_read_length(source, 1 << (head - MSGPACK_FORMAT_BIN_8), length, start, result)) {
+                        return false;
+                    }
+                    break;
+                case MSGPACK_FORMAT_ARRAY_16:
+                case MSGPACK_FORMAT_ARRAY_32:
+                    item.kind = KIND_ARRAY;
+                    return _read_length(source, head == MSGPACK_FORMAT_ARRAY_16 ? 2 : 4, item.length, start, result);
+                case MSGPACK_FORMAT_MAP_16:
+                case MSGPACK_FORMAT_MAP_32:
+                    item.kind = KIND_MAP;
+                    return _read_length(source, head == MSGPACK_FORMAT_MAP_16 ? 2 : 4, item.length, start, result);
+                case MSGPACK_FORMAT_FIXEXT_1:
+                case MSGPACK_FORMAT_FIXEXT_2:
+                case MSGPACK_FORMAT_FIXEXT_4:
+                case MSGPACK_FORMAT_FIXEXT_8:
+                case MSGPACK_FORMAT_FIXEXT_16:
+                    item.kind = KIND_EXT;
+                    length = int64_t(1) << (head - MSGPACK_FORMAT_FIXEXT_1);
+                    break;
+                case MSGPACK_FORMAT_EXT_8:
+                case MSGPACK_FORMAT_EXT_16:
+                case MSGPACK_FORMAT_EXT_32:
+                    item.kind = KIND_EXT;
+                    if (!_read_length(source, 1 << (head - MSGPACK_FORMAT_EXT_8), length, start, result)) {
+                        return false;
+                    }
+                    break;
+                default:
+                    result.set(STATUS_INVALID, start, "Invalid byte tag!");
+                    return false;
+            }
+        }
+
+        if (scalar > 0) {
+            if (!source.has(scalar)) {
+                result.set(STATUS_TRUNCATED, start, "Not enough buffer for value!");
+                return false;
+            }
+            switch (head) {
+                case MSGPACK_FORMAT_UINT_8:
+                    item.integer = source.get_u8();
+                    break;
+                case MSGPACK_FORMAT_UINT_16:
+                    item.integer = source.get_u16();
+                    break;
+                case MSGPACK_FORMAT_UINT_32:
+                    item.integer = source.get_u32();
+                    break;
+                case MSGPACK_FORMAT_UINT_64:
+                    item.integer = int64_t(source.get_u64());
+                    break;
+                case MSGPACK_FORMAT_INT_8:
+                    item.integer = int8_t(source.get_u8());
+                    break;
+                case MSGPACK_FORMAT_INT_16:
+                    item.integer = int16_t(source.get_u16());
+                    break;
+                case MSGPACK_FORMAT_INT_32:
+                    item.integer = int32_t(source.get_u32());
+                    break;
+                case MSGPACK_FORMAT_INT_64:
+                    item.integer = int64_t(source.get_u64());
+                    break;
+                case MSGPACK_FORMAT_FLOAT_32:
+                    item.real = source.get_float();
+                    break;
+                default:
+                    item.real = source.get_double();
+                    break;
+            }
+            return true;
+        }
+
+        // STR, BIN and EXT, the ext type byte comes before the payload.
+        int64_t type_size = item.kind == KIND_EXT ? 1 : 0;
+        if (!source.has(length + type_size)) {
+            result.set(STATUS_TRUNCATED, start, "Not enough buffer for payload!");
+            return false;
+        }
+        if (type_size > 0) {
+            item.ext_type = int8_t(source.get_u8());
+        }
+        item.length = length;
+        item.data = source.get_data(length);
+        return true;
+    }
+
+    // Advances the source past one complete value without decoding it.
+    // Containers only add to the number of values still to skip, so nesting
+    // depth costs nothing here.
+    template <class Source>
+    bool skip(Source &source, Result &result) {
+        int64_t pending = 1;
+        Item item;
+        while (pending > 0) {
+            pending--;
+            if (!read_item(source, item, result)) {
+                return false;
+            }
+            if (item.kind == KIND_ARRAY) {
+                pending += item.length;
+            } else if (item.kind == KIND_MAP) {
+                pending += item.length * 2;
+            }
+        }
+        return true;
+    }
+}
+
+#endif //MSGPACK_CORE_HPP
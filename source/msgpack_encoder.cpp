@@ -0,0 +1,98 @@
+#include "msgpack_encoder.hpp"
+
+#include <godot_cpp/core/class_db.hpp>
+
+using namespace godot;
+
+Error MsgpackEncoder::append(const Variant& value) {
+    int64_t size = writer.get_size();
+    MsgpackError error;
+    Msgpack::_pack(value, writer, error);
+    return _rollback(size, error);
+}
+
+Error MsgpackEncoder::write_array_header(int64_t size) {
+    ERR_FAIL_COND_V(size < 0, ERR_INVALID_PARAMETER);
+    int64_t start = writer.get_size();
+    MsgpackError error;
+    Msgpack::_pack_array_header(writer, size, error);
+    return _rollback(start, error);
+}
+
+Error MsgpackEncoder::write_map_header(int64_t size) {
+    ERR_FAIL_COND_V(size < 0, ERR_INVALID_PARAMETER);
+    int64_t start = writer.get_size();
+    MsgpackError error;
+    Msgpack::_pack_map_header(writer, size, error);
+    return _rollback(start, error);
+}
+
+Error MsgpackEncoder::write_timestamp(double unix_time) {
+    int64_t start = writer.get_size();
+    MsgpackError error;
+    Msgpack::_pack_timestamp(writer, unix_time, error);
+    return _rollback(start, error);
+}
+
+Error MsgpackEncoder::write_raw(const PackedByteArray& bytes) {
+    int64_t start = writer.get_size();
+    writer.put_data(bytes.ptr(), bytes.size());
+    if (writer.is_failed()) {
+        writer.reset_to(start);
+        ERR_FAIL_V_MSG(ERR_OUT_OF_MEMORY, "Out of memory!");
+    }
+    return OK;
+}
+
+PackedByteArray MsgpackEncoder::get_bytes() const {
+    return writer.get_bytes();
+}
+
+int64_t MsgpackEncoder::get_size() const {
+    return writer.get_size();
+}
+
+void MsgpackEncoder::clear() {
+    writer.clear();
+}
+
+void MsgpackEncoder::reserve(int64_t bytes) {
+    ERR_FAIL_COND(bytes < 0);
+    writer.reserve(bytes);
+}
+
+void MsgpackEncoder::set_flags(BitField<Msgpack::PackFlags> p_flags) {
+    // Values are appended to one buffer, there is no frame to compress.
+    writer.flags = uint32_t(int64_t(p_flags)) & ~uint32_t(Msgpack::PACK_COMPRESS);
+}
+
+BitField<Msgpack::PackFlags> MsgpackEncoder::get_flags() const {
+    return int64_t(writer.flags);
+}
+
+void MsgpackEncoder::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("append", "value"), &MsgpackEncoder::append);
+    ClassDB::bind_method(D_METHOD("write_array_header", "size"), &MsgpackEncoder::write_array_header);
+    ClassDB::bind_method(D_METHOD("write_map_header", "size"), &MsgpackEncoder::write_map_header);
+    ClassDB::bind_method(D_METHOD("write_timestamp", "unix_time"), &MsgpackEncoder::write_timestamp);
+    ClassDB::bind_method(D_METHOD("write_raw", "bytes"), &MsgpackEncoder::write_raw);
+    ClassDB::bind_method(D_METHOD("get_bytes"), &MsgpackEncoder::get_bytes);
+    ClassDB::bind_method(D_METHOD("get_size"), &MsgpackEncoder::get_size);
+    ClassDB::bind_method(D_METHOD("clear"), &MsgpackEncoder::clear);
+    ClassDB::bind_method(D_METHOD("reserve", "bytes"), &MsgpackEncoder::reserve);
+    ClassDB::bind_method(D_METHOD("set_flags", "flags"), &MsgpackEncoder::set_flags);
+    ClassDB::bind_method(D_METHOD("get_flags"), &MsgpackEncoder::get_flags);
+
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "flags", PROPERTY_HINT_FLAGS, "Compact Numbers:1,Objects:4"), "set_flags", "get_flags");
+}
+
+// Drops a partially written value so a failed call leaves the stream as
+// it was.
+Error MsgpackEncoder::_rollback(int64_t size, const MsgpackError &error) {
+    if (!error.failed()) {
+        return OK;
+    }
+    writer.reset_to(size);
+    Msgpack::_print_error(error);
+    return error.code;
+}
@@ -0,0 +1,42 @@
+#ifndef MSGPACK_ENCODER_HPP
+#define MSGPACK_ENCODER_HPP
+
+#include "msgpack.hpp"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+
+namespace godot {
+    // Encoder with a buffer that is kept between messages. Values are
+    // appended back to back, clear() starts over without giving up capacity.
+    class MsgpackEncoder : public RefCounted {
+        GDCLASS(MsgpackEncoder, RefCounted)
+
+    public:
+        Error append(const Variant& value);
+        Error write_array_header(int64_t size);
+        Error write_map_header(int64_t size);
+        Error write_timestamp(double unix_time);
+        Error write_raw(const PackedByteArray& bytes);
+
+        PackedByteArray get_bytes() const;
+        int64_t get_size() const;
+        void clear();
+        void reserve(int64_t bytes);
+
+        void set_flags(BitField<Msgpack::PackFlags> p_flags);
+        BitField<Msgpack::PackFlags> get_flags() const;
+
+    protected:
+        static void _bind_methods();
+
+    private:
+        // Msgpack::pack_into() writes into it directly.
+        friend class Msgpack;
+
+        MsgpackWriter writer;
+
+        Error _rollback(int64_t size, const MsgpackError &error);
+    };
+}
+
+#endif //MSGPACK_ENCODER_HPP
@@ -0,0 +1,53 @@
+#ifndef MSGPACK_ERROR_HPP
+#define MSGPACK_ERROR_HPP
+
+#include "msgpack_core.hpp"
+
+#include <godot_cpp/classes/global_constants.hpp>
+#include <godot_cpp/core/defs.hpp>
+#include <godot_cpp/variant/variant.hpp>
+
+#include <cstdint>
+
+namespace godot {
+    // Error state threaded through the codec. Messages are static strings so
+    // that failing on hostile input does not allocate.
+    struct MsgpackError {
+        Error code = OK;
+        int64_t offset = 0;
+        const char *message = "";
+        Variant::Type type = Variant::NIL;
+
+        _FORCE_INLINE_ bool failed() const {
+            return code != OK;
+        }
+
+        _FORCE_INLINE_ void set(Error p_code, int64_t p_offset, const char *p_message) {
+            code = p_code;
+            offset = p_offset;
+            message = p_message;
+        }
+
+        // Takes over a failure reported by the engine-independent core.
+        void set(const msgpack_core::Result &p_result) {
+            switch (p_result.status) {
+                case msgpack_core::STATUS_OK:
+                    code = OK;
+                    break;
+                case msgpack_core::STATUS_TRUNCATED:
+                    code = ERR_FILE_EOF;
+                    break;
+                case msgpack_core::STATUS_INVALID:
+                    code = ERR_INVALID_DATA;
+                    break;
+                case msgpack_core::STATUS_TOO_LARGE:
+                    code = ERR_OUT_OF_MEMORY;
+                    break;
+            }
+            offset = p_result.offset;
+            message = p_result.message;
+        }
+    };
+}
+
+#endif //MSGPACK_ERROR_HPP
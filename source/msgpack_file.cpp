@@ -0,0 +1,333 @@
+#include "msgpack_file.hpp"
+
+#include "msgpack.hpp"
+
+#include <godot_cpp/core/class_db.hpp>
+
+using namespace godot;
+
+// Index files hold [magic, version, size, modification time and last bytes
+// of the indexed file, offsets].
+static const char *MSGPACK_INDEX_MAGIC = "MPIX";
+static const int64_t MSGPACK_INDEX_VERSION = 2;
+// Bytes at the end of the file kept in the index, so a rewrite of the same
+// size within the timestamp resolution is noticed too.
+static const int64_t MSGPACK_INDEX_TAIL = 64;
+
+MsgpackFile::~MsgpackFile() {
+    close();
+}
+
+Error MsgpackFile::open(const String& p_path, bool p_writable) {
+    close();
+    FileAccess::ModeFlags mode = FileAccess::READ;
+    if (p_writable) {
+        mode = FileAccess::file_exists(p_path) ? FileAccess::READ_WRITE : FileAccess::WRITE_READ;
+    }
+    file = FileAccess::open(p_path, mode);
+    if (file.is_null()) {
+        return FileAccess::get_open_error();
+    }
+    path = p_path;
+    writable = p_writable;
+    _reset_buffer(0);
+    record = 0;
+    if (persist_index) {
+        _load_index();
+    }
+    return OK;
+}
+
+void MsgpackFile::close() {
+    if (file.is_null()) {
+        return;
+    }
+    // Read-only opens never write next to the file, save_index() still can.
+    if (persist_index && writable && index_dirty) {
+        save_index();
+    }
+    file->close();
+    file.unref();
+    path = String();
+    writable = false;
+    buffer = PackedByteArray();
+    buffer_offset = 0;
+    buffer_begin = 0;
+    record = 0;
+    stopped = false;
+    index = PackedInt64Array();
+    index_complete = false;
+    index_dirty = false;
+    error = MsgpackError();
+}
+
+bool MsgpackFile::is_open() const {
+    return file.is_valid();
+}
+
+Variant MsgpackFile::read_next() {
+    ERR_FAIL_COND_V_MSG(file.is_null(), Variant(), "File not open.");
+    int64_t length = _next_record();
+    if (length < 0 || error.failed()) {
+        stopped = true;
+    }
+    if (length <= 0) {
+        return Variant();
+    }
+
+    // A record that is well-formed but fails to decode is still consumed,
+    // so reading can go on with the next one.
+    MsgpackReader reader(buffer.ptr() + buffer_begin, length);
+    Variant value = Msgpack::_unpack(reader, error);
+    if (error.failed()) {
+        error.offset += buffer_offset + buffer_begin;
+        Msgpack::_print_error(error);
+        value = Variant();
+    }
+    buffer_begin += length;
+    record++;
+    return value;
+}
+
+Error MsgpackFile::append(const Variant& value) {
+    ERR_FAIL_COND_V_MSG(file.is_null(), ERR_UNCONFIGURED, "File not open.");
+    ERR_FAIL_COND_V_MSG(!writable, ERR_FILE_NO_PERMISSION, "File not opened as writable.");
+    MsgpackWriter writer(Msgpack::_estimate_size(value));
+    MsgpackError pack_error;
+    Msgpack::_pack(value, writer, pack_error);
+    if (pack_error.failed()) {
+        Msgpack::_print_error(pack_error);
+        return pack_error.code;
+    }
+
+    int64_t offset = file->get_length();
+    file->seek_end();
+    if (!file->store_buffer(writer.finish())) {
+        return ERR_FILE_CANT_WRITE;
+    }
+    if (index_complete) {
+        index.push_back(offset);
+        index_dirty = true;
+    }
+    return OK;
+}
+
+Error MsgpackFile::seek_record(int64_t p_record) {
+    ERR_FAIL_COND_V_MSG(file.is_null(), ERR_UNCONFIGURED, "File not open.");
+    if (!index_complete) {
+        Error err = build_index();
+        if (err != OK) {
+            return err;
+        }
+    }
+    ERR_FAIL_INDEX_V(p_record, index.size() + 1, ERR_PARAMETER_RANGE_ERROR);
+    _reset_buffer(p_record < index.size() ? index[p_record] : int64_t(file->get_length()));
+    record = p_record;
+    return OK;
+}
+
+int64_t MsgpackFile::get_record() const {
+    return record;
+}
+
+int64_t MsgpackFile::get_record_count() {
+    ERR_FAIL_COND_V_MSG(file.is_null(), -1, "File not open.");
+    if (!index_complete && build_index() != OK) {
+        return -1;
+    }
+    return index.size();
+}
+
+bool MsgpackFile::eof_reached() const {
+    return file.is_null() || stopped || buffer_offset + buffer_begin >= int64_t(file->get_length());
+}
+
+Error MsgpackFile::build_index() {
+    ERR_FAIL_COND_V_MSG(file.is_null(), ERR_UNCONFIGURED, "File not open.");
+    // Records are skipped, not decoded, through the same buffer as reads.
+    int64_t resume = buffer_offset + buffer_begin;
+    PackedInt64Array offsets;
+    _reset_buffer(0);
+    while (true) {
+        int64_t length = _next_record();
+        if (length < 0) {
+            _reset_buffer(resume);
+            return error.code;
+        }
+        if (length == 0) {
+            break;
+        }
+        offsets.push_back(buffer_offset + buffer_begin);
+        buffer_begin += length;
+    }
+    index = offsets;
+    index_complete = true;
+    index_dirty = true;
+    _reset_buffer(resume);
+    return OK;
+}
+
+Error MsgpackFile::save_index() {
+    ERR_FAIL_COND_V_MSG(file.is_null(), ERR_UNCONFIGURED, "File not open.");
+    ERR_FAIL_COND_V_MSG(!index_complete, ERR_UNCONFIGURED, "No index to save.");
+    // Written data has to reach the file before its time is taken.
+    file->flush();
+    Array data;
+    data.push_back(MSGPACK_INDEX_MAGIC);
+    data.push_back(MSGPACK_INDEX_VERSION);
+    data.push_back(int64_t(file->get_length()));
+    data.push_back(int64_t(FileAccess::get_modified_time(path)));
+    data.push_back(_read_tail());
+    data.push_back(index);
+    MsgpackWriter writer(128 + index.size() * 8);
+    MsgpackError pack_error;
+    Msgpack::_pack(data, writer, pack_error);
+    ERR_FAIL_COND_V(pack_error.failed(), pack_error.code);
+
+    Ref<FileAccess> index_file = FileAccess::open(path + ".idx", FileAccess::WRITE);
+    if (index_file.is_null()) {
+        return FileAccess::get_open_error();
+    }
+    if (!index_file->store_buffer(writer.finish())) {
+        return ERR_FILE_CANT_WRITE;
+    }
+    index_dirty = false;
+    return OK;
+}
+
+void MsgpackFile::set_chunk_size(int64_t p_size) {
+    ERR_FAIL_COND(p_size < 16);
+    chunk_size = p_size;
+}
+
+int64_t MsgpackFile::get_chunk_size() const {
+    return chunk_size;
+}
+
+void MsgpackFile::set_persist_index(bool p_enabled) {
+    persist_index = p_enabled;
+}
+
+bool MsgpackFile::is_persist_index() const {
+    return persist_index;
+}
+
+Error MsgpackFile::get_error() const {
+    return error.code;
+}
+
+int64_t MsgpackFile::get_error_offset() const {
+    return error.offset;
+}
+
+String MsgpackFile::get_error_message() const {
+    return error.message;
+}
+
+void MsgpackFile::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("open", "path", "writable"), &MsgpackFile::open, DEFVAL(false));
+    ClassDB::bind_method(D_METHOD("close"), &MsgpackFile::close);
+    ClassDB::bind_method(D_METHOD("is_open"), &MsgpackFile::is_open);
+    ClassDB::bind_method(D_METHOD("read_next"), &MsgpackFile::read_next);
+    ClassDB::bind_method(D_METHOD("append", "value"), &MsgpackFile::append);
+    ClassDB::bind_method(D_METHOD("seek_record", "record"), &MsgpackFile::seek_record);
+    ClassDB::bind_method(D_METHOD("get_record"), &MsgpackFile::get_record);
+    ClassDB::bind_method(D_METHOD("get_record_count"), &MsgpackFile::get_record_count);
+    ClassDB::bind_method(D_METHOD("eof_reached"), &MsgpackFile::eof_reached);
+    ClassDB::bind_method(D_METHOD("build_index"), &MsgpackFile::build_index);
+    ClassDB::bind_method(D_METHOD("save_index"), &MsgpackFile::save_index);
+    ClassDB::bind_method(D_METHOD("set_chunk_size", "size"), &MsgpackFile::set_chunk_size);
+    ClassDB::bind_method(D_METHOD("get_chunk_size"), &MsgpackFile::get_chunk_size);
+    ClassDB::bind_method(D_METHOD("set_persist_index", "enabled"), &MsgpackFile::set_persist_index);
+    ClassDB::bind_method(D_METHOD("is_persist_index"), &MsgpackFile::is_persist_index);
+    ClassDB::bind_method(D_METHOD("get_error"), &MsgpackFile::get_error);
+    ClassDB::bind_method(D_METHOD("get_error_offset"), &MsgpackFile::get_error_offset);
+    ClassDB::bind_method(D_METHOD("get_error_message"), &MsgpackFile::get_error_message);
+
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "chunk_size"), "set_chunk_size", "get_chunk_size");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "persist_index"), "set_persist_index", "is_persist_index");
+}
+
+void MsgpackFile::_reset_buffer(int64_t offset) {
+    buffer.clear();
+    buffer_offset = offset;
+    buffer_begin = 0;
+    stopped = false;
+}
+
+int64_t MsgpackFile::_next_record() {
+    error = MsgpackError();
+    int64_t file_length = file->get_length();
+    while (true) {
+        MsgpackReader reader(buffer.ptr() + buffer_begin, buffer.size() - buffer_begin);
+        msgpack_core::Result result;
+        if (reader.get_available() > 0 && msgpack_core::skip(reader, result)) {
+            return reader.get_position();
+        }
+        int64_t loaded = buffer_offset + buffer.size();
+        if (result.status == msgpack_core::STATUS_INVALID || result.status == msgpack_core::STATUS_TOO_LARGE || loaded >= file_length) {
+            if (reader.get_available() == 0) {
+                return 0;
+            }
+            error.set(result);
+            error.offset += buffer_offset + buffer_begin;
+            Msgpack::_print_error(error);
+            // Typically an append that did not complete.
+            return result.status == msgpack_core::STATUS_TRUNCATED ? 0 : -1;
+        }
+
+        // The record continues past the buffer. Drop what was consumed and
+        // read at least another chunk, or as much again as the partial
+        // record when that is larger.
+        buffer = buffer.slice(buffer_begin);
+        buffer_offset += buffer_begin;
+        buffer_begin = 0;
+        int64_t amount = MIN(MAX(chunk_size, int64_t(buffer.size())), file_length - loaded);
+        file->seek(loaded);
+        PackedByteArray data = file->get_buffer(amount);
+        if (data.size() != amount) {
+            error.set(Error::ERR_FILE_CANT_READ, loaded, "Failed to read from file!");
+            Msgpack::_print_error(error);
+            return -1;
+        }
+        buffer.append_array(data);
+    }
+}
+
+bool MsgpackFile::_load_index() {
+    String index_path = path + ".idx";
+    if (!FileAccess::file_exists(index_path)) {
+        return false;
+    }
+    Ref<FileAccess> index_file = FileAccess::open(index_path, FileAccess::READ);
+    if (index_file.is_null()) {
+        return false;
+    }
+    PackedByteArray bytes = index_file->get_buffer(index_file->get_length());
+    MsgpackReader reader(bytes.ptr(), bytes.size());
+    MsgpackError index_error;
+    Variant data = Msgpack::_unpack(reader, index_error);
+    if (index_error.failed() || data.get_type() != Variant::ARRAY) {
+        return false;
+    }
+
+    // Stale once the file was written without going through this class.
+    Array fields = data;
+    if (fields.size() != 6 || fields[0] != Variant(MSGPACK_INDEX_MAGIC) || fields[1] != Variant(MSGPACK_INDEX_VERSION) ||
+            fields[2] != Variant(int64_t(file->get_length())) || fields[3] != Variant(int64_t(FileAccess::get_modified_time(path))) ||
+            fields[4] != Variant(_read_tail()) || fields[5].get_type() != Variant::PACKED_INT64_ARRAY) {
+        return false;
+    }
+    index = fields[5];
+    index_complete = true;
+    index_dirty = false;
+    return true;
+}
+
+PackedByteArray MsgpackFile::_read_tail() {
+    // Reads seek explicitly, so moving the position here is harmless.
+    int64_t length = file->get_length();
+    int64_t size = MIN(length, MSGPACK_INDEX_TAIL);
+    file->seek(length - size);
+    return file->get_buffer(size);
+}
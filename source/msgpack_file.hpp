@@ -0,0 +1,82 @@
+#ifndef MSGPACK_FILE_HPP
+#define MSGPACK_FILE_HPP
+
+#include "msgpack_error.hpp"
+
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+
+namespace godot {
+    // File holding a sequence of msgpack records. Records are read through a
+    // buffer of chunk_size bytes, grown only for records larger than that,
+    // so memory use does not depend on the file size. Seeking by record uses
+    // an index of record offsets, built on demand by skipping over records
+    // and kept next to the file in <path>.idx when persist_index is set. The
+    // index is only written on close() for files opened writable.
+    class MsgpackFile : public RefCounted {
+        GDCLASS(MsgpackFile, RefCounted)
+
+    public:
+        ~MsgpackFile();
+
+        Error open(const String& path, bool writable = false);
+        void close();
+        bool is_open() const;
+
+        Variant read_next();
+        Error append(const Variant& value);
+        Error seek_record(int64_t record);
+        int64_t get_record() const;
+        int64_t get_record_count();
+        bool eof_reached() const;
+
+        Error build_index();
+        Error save_index();
+
+        void set_chunk_size(int64_t p_size);
+        int64_t get_chunk_size() const;
+        void set_persist_index(bool p_enabled);
+        bool is_persist_index() const;
+
+        Error get_error() const;
+        int64_t get_error_offset() const;
+        String get_error_message() const;
+
+    protected:
+        static void _bind_methods();
+
+    private:
+        Ref<FileAccess> file;
+        String path;
+        bool writable = false;
+        int64_t chunk_size = 64 * 1024;
+        bool persist_index = true;
+
+        // File bytes from buffer_offset on, the next record starts at buffer_begin.
+        PackedByteArray buffer;
+        int64_t buffer_offset = 0;
+        int64_t buffer_begin = 0;
+        int64_t record = 0;
+        // Set when a malformed or truncated record ends reading, until the
+        // next seek.
+        bool stopped = false;
+
+        // Start offset of every record, only used once index_complete is set.
+        PackedInt64Array index;
+        bool index_complete = false;
+        bool index_dirty = false;
+
+        MsgpackError error;
+
+        void _reset_buffer(int64_t offset);
+        // Makes the next record available in the buffer and returns its size,
+        // 0 at the end of the data and -1 on errors. A record cut off by the
+        // end of the file ends the data, with the error set.
+        int64_t _next_record();
+        bool _load_index();
+        // Last bytes of the file, to tell whether a saved index still fits.
+        PackedByteArray _read_tail();
+    };
+}
+
+#endif //MSGPACK_FILE_HPP
@@ -0,0 +1,116 @@
+#include "msgpack_key_cache.hpp"
+
+#include "msgpack.hpp"
+#include "msgpack_common.hpp"
+
+#include <godot_cpp/core/memory.hpp>
+#include <godot_cpp/templates/hashfuncs.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace godot;
+
+// Caches are owned by the registry. A thread keeps a plain pointer to its
+// own, valid while its generation matches the registry's, and clears it
+// once cleared falls behind key_cache_cleared.
+struct MsgpackThreadKeyCache {
+    MsgpackKeyCache *cache = nullptr;
+    uint64_t generation = 0;
+    uint64_t cleared = 0;
+};
+
+static thread_local MsgpackThreadKeyCache thread_key_cache;
+static std::atomic<uint64_t> key_cache_generation = { 1 };
+static std::atomic<uint64_t> key_cache_cleared = { 0 };
+static std::mutex key_cache_mutex;
+static std::vector<MsgpackKeyCache *> key_caches;
+
+bool MsgpackKeyCache::unpack_key(MsgpackReader &reader, Variant &key) {
+    if (!reader.has(1)) {
+        return false;
+    }
+    const uint8_t *head = reader.peek();
+    int64_t header;
+    int64_t length;
+    if ((head[0] & 0xE0) == MSGPACK_FORMAT_FIXSTR) {
+        header = 1;
+        length = head[0] & 0x1f;
+    } else if (head[0] == MSGPACK_FORMAT_STR_8 && reader.has(2)) {
+        header = 2;
+        length = head[1];
+    } else {
+        return false;
+    }
+    if (length > MAX_KEY_LENGTH || !reader.has(header + length)) {
+        return false;
+    }
+
+    const uint8_t *data = head + header;
+    uint32_t hash = hash_murmur3_buffer(data, int(length));
+    if (!_lookup(data, length, hash, key)) {
+        String value = Msgpack::_unpack_string(data, length);
+        _store(data, length, hash, value);
+        key = value;
+    }
+    reader.get_data(header + length);
+    return true;
+}
+
+void MsgpackKeyCache::clear() {
+    slots.clear();
+}
+
+MsgpackKeyCache *MsgpackKeyCache::get_thread_cache() {
+    uint64_t generation = key_cache_generation.load(std::memory_order_acquire);
+    if (thread_key_cache.generation != generation) {
+        MsgpackKeyCache *cache = memnew(MsgpackKeyCache);
+        std::lock_guard<std::mutex> lock(key_cache_mutex);
+        key_caches.push_back(cache);
+        thread_key_cache.cache = cache;
+        thread_key_cache.generation = generation;
+    }
+    uint64_t cleared = key_cache_cleared.load(std::memory_order_relaxed);
+    if (thread_key_cache.cleared != cleared) {
+        thread_key_cache.cache->clear();
+        thread_key_cache.cleared = cleared;
+    }
+    return thread_key_cache.cache;
+}
+
+void MsgpackKeyCache::clear_thread_caches() {
+    key_cache_cleared.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MsgpackKeyCache::free_thread_caches() {
+    std::lock_guard<std::mutex> lock(key_cache_mutex);
+    key_cache_generation.fetch_add(1, std::memory_order_release);
+    for (MsgpackKeyCache *cache : key_caches) {
+        memdelete(cache);
+    }
+    key_caches.clear();
+}
+
+bool MsgpackKeyCache::_lookup(const uint8_t *data, int64_t length, uint32_t hash, Variant &key) {
+    if (slots.is_empty()) {
+        return false;
+    }
+    const Slot &slot = slots[hash % SLOT_COUNT];
+    if (slot.hash != hash || slot.length != length || memcmp(slot.bytes, data, length) != 0) {
+        return false;
+    }
+    key = slot.value;
+    return true;
+}
+
+void MsgpackKeyCache::_store(const uint8_t *data, int64_t length, uint32_t hash, const String &value) {
+    if (slots.is_empty()) {
+        slots.resize(SLOT_COUNT);
+    }
+    Slot &slot = slots[hash % SLOT_COUNT];
+    slot.hash = hash;
+    slot.length = length;
+    memcpy(slot.bytes, data, length);
+    slot.value = value;
+}
@@ -0,0 +1,51 @@
+#ifndef MSGPACK_KEY_CACHE_HPP
+#define MSGPACK_KEY_CACHE_HPP
+
+#include "msgpack_reader.hpp"
+
+#include <godot_cpp/templates/local_vector.hpp>
+#include <godot_cpp/variant/variant.hpp>
+
+namespace godot {
+    // Bounded cache mapping the raw UTF-8 bytes of short map keys to already
+    // decoded Strings, so keys repeated across messages cost a hash probe
+    // instead of an allocation and a transcode. Direct-mapped, a colliding
+    // key replaces the previous one. Not thread-safe, every thread decoding
+    // through the Msgpack singleton uses a cache of its own, so lookups take
+    // no lock.
+    class MsgpackKeyCache {
+    public:
+        static constexpr int64_t MAX_KEY_LENGTH = 64;
+        static constexpr uint32_t SLOT_COUNT = 256;
+
+        // Decodes the string key at the reader position through the cache.
+        // Returns false, without consuming anything, if the next value is not
+        // a short string.
+        bool unpack_key(MsgpackReader &reader, Variant &key);
+        void clear();
+
+        // Cache of the calling thread, created on first use.
+        static MsgpackKeyCache *get_thread_cache();
+        // Empties the caches of all threads. Each one is cleared by its own
+        // thread before its next use, so this is safe while decoding.
+        static void clear_thread_caches();
+        // Frees the caches of all threads. Only safe while nothing is
+        // decoding, threads create a new cache on their next use.
+        static void free_thread_caches();
+
+    private:
+        struct Slot {
+            uint32_t hash = 0;
+            int64_t length = -1;
+            uint8_t bytes[MAX_KEY_LENGTH];
+            String value;
+        };
+
+        LocalVector<Slot> slots;
+
+        bool _lookup(const uint8_t *data, int64_t length, uint32_t hash, Variant &key);
+        void _store(const uint8_t *data, int64_t length, uint32_t hash, const String &value);
+    };
+}
+
+#endif //MSGPACK_KEY_CACHE_HPP
@@ -0,0 +1,73 @@
+#include "msgpack_name_cache.hpp"
+
+#include "msgpack_core.hpp"
+
+#include <godot_cpp/core/memory.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace godot;
+
+// Caches are owned by the registry. A thread keeps a plain pointer to its
+// own, valid while its generation matches the registry's.
+struct MsgpackThreadNameCache {
+    MsgpackNameCache *cache = nullptr;
+    uint64_t generation = 0;
+};
+
+static thread_local MsgpackThreadNameCache thread_name_cache;
+static std::atomic<uint64_t> name_cache_generation = { 1 };
+static std::mutex name_cache_mutex;
+static std::vector<MsgpackNameCache *> name_caches;
+
+bool MsgpackNameCache::pack(const StringName& name, MsgpackWriter &writer) {
+    uint32_t hash = name.hash();
+    if (!slots.is_empty()) {
+        const Slot &slot = slots[hash % SLOT_COUNT];
+        if (slot.length >= 0 && slot.name == name) {
+            writer.put_data(slot.bytes, slot.length);
+            return true;
+        }
+    }
+
+    CharString utf8 = String(name).utf8();
+    int64_t start = writer.get_size();
+    if (!msgpack_core::write_str(writer, utf8.get_data(), utf8.length())) {
+        return false;
+    }
+    if (utf8.length() > MAX_NAME_LENGTH || writer.is_failed()) {
+        return true;
+    }
+
+    if (slots.is_empty()) {
+        slots.resize(SLOT_COUNT);
+    }
+    Slot &slot = slots[hash % SLOT_COUNT];
+    slot.name = name;
+    slot.length = writer.get_size() - start;
+    memcpy(slot.bytes, writer.get_data_at(start), slot.length);
+    return true;
+}
+
+MsgpackNameCache *MsgpackNameCache::get_thread_cache() {
+    uint64_t generation = name_cache_generation.load(std::memory_order_acquire);
+    if (thread_name_cache.generation != generation) {
+        MsgpackNameCache *cache = memnew(MsgpackNameCache);
+        std::lock_guard<std::mutex> lock(name_cache_mutex);
+        name_caches.push_back(cache);
+        thread_name_cache.cache = cache;
+        thread_name_cache.generation = generation;
+    }
+    return thread_name_cache.cache;
+}
+
+void MsgpackNameCache::free_thread_caches() {
+    std::lock_guard<std::mutex> lock(name_cache_mutex);
+    name_cache_generation.fetch_add(1, std::memory_order_release);
+    for (MsgpackNameCache *cache : name_caches) {
+        memdelete(cache);
+    }
+    name_caches.clear();
+}
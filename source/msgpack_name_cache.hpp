@@ -0,0 +1,42 @@
+#ifndef MSGPACK_NAME_CACHE_HPP
+#define MSGPACK_NAME_CACHE_HPP
+
+#include "msgpack_writer.hpp"
+
+#include <godot_cpp/templates/local_vector.hpp>
+#include <godot_cpp/variant/string_name.hpp>
+
+namespace godot {
+    // Bounded cache of packed StringNames, so identifiers repeated across
+    // messages are copied as ready-made msgpack strings instead of being
+    // transcoded to UTF-8 every time. Direct-mapped on the StringName hash,
+    // a colliding name replaces the previous one. Every thread packs through
+    // a cache of its own, so lookups take no lock.
+    class MsgpackNameCache {
+    public:
+        static constexpr int64_t MAX_NAME_LENGTH = 64;
+        static constexpr uint32_t SLOT_COUNT = 256;
+
+        // Packs name as a msgpack string. Returns false if it is too long
+        // for the format.
+        bool pack(const StringName& name, MsgpackWriter &writer);
+
+        // Cache of the calling thread, created on first use.
+        static MsgpackNameCache *get_thread_cache();
+        // Frees the caches of all threads. Only safe while nothing is
+        // packing, threads create a new cache on their next use.
+        static void free_thread_caches();
+
+    private:
+        struct Slot {
+            StringName name;
+            // Header and UTF-8 bytes, -1 while the slot is empty.
+            int64_t length = -1;
+            uint8_t bytes[MAX_NAME_LENGTH + 2];
+        };
+
+        LocalVector<Slot> slots;
+    };
+}
+
+#endif //MSGPACK_NAME_CACHE_HPP
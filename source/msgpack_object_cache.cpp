@@ -0,0 +1,131 @@
+#include "msgpack_object_cache.hpp"
+
+#include "msgpack_core.hpp"
+#include "msgpack_writer.hpp"
+
+#include <godot_cpp/classes/class_db_singleton.hpp>
+#include <godot_cpp/core/memory.hpp>
+#include <godot_cpp/variant/typed_array.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace godot;
+
+// Caches are owned by the registry. A thread keeps a plain pointer to its
+// own, valid while its generation matches the registry's.
+struct MsgpackThreadObjectCache {
+    MsgpackObjectCache *cache = nullptr;
+    uint64_t generation = 0;
+};
+
+static thread_local MsgpackThreadObjectCache thread_object_cache;
+static std::atomic<uint64_t> object_cache_generation = { 1 };
+static std::mutex object_cache_mutex;
+static std::vector<MsgpackObjectCache *> object_caches;
+
+static const StringName &_script_name() {
+    static const StringName name = "script";
+    return name;
+}
+
+// Number of storage properties in list, except the script.
+static int64_t _count_storage(const TypedArray<Dictionary>& list) {
+    int64_t count = 0;
+    for (int64_t i = 0; i < list.size(); i++) {
+        Dictionary property = list[i];
+        int64_t usage = property["usage"];
+        if ((usage & PROPERTY_USAGE_STORAGE) && StringName(property["name"]) != _script_name()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+MsgpackObjectCache::~MsgpackObjectCache() {
+    for (const KeyValue<uint64_t, Entry *> &E : entries) {
+        memdelete(E.value);
+    }
+}
+
+const MsgpackObjectCache::Entry *MsgpackObjectCache::get(Object *object, const String& class_name) {
+    Script *script = Object::cast_to<Script>(object->get_script());
+    uint64_t script_id = script != nullptr ? script->get_instance_id() : 0;
+    uint64_t key = (uint64_t(class_name.hash()) << 32) ^ script_id;
+
+    Entry **found = entries.getptr(key);
+    if (found == nullptr) {
+        Entry *entry = _build(object, class_name, script);
+        entries.insert(key, entry);
+        return entry;
+    }
+    if ((*found)->script_id != script_id || (*found)->class_name != class_name) {
+        return nullptr;
+    }
+    return *found;
+}
+
+void MsgpackObjectCache::read_properties(Object *object, LocalVector<StringName> &properties) {
+    TypedArray<Dictionary> list = object->get_property_list();
+    for (int64_t i = 0; i < list.size(); i++) {
+        Dictionary property = list[i];
+        int64_t usage = property["usage"];
+        StringName name = property["name"];
+        if ((usage & PROPERTY_USAGE_STORAGE) && name != _script_name()) {
+            properties.push_back(name);
+        }
+    }
+}
+
+MsgpackObjectCache::Entry *MsgpackObjectCache::_build(Object *object, const String& class_name, Script *script) {
+    Entry *entry = memnew(Entry);
+    entry->class_name = class_name;
+    entry->script_id = script != nullptr ? script->get_instance_id() : 0;
+    entry->script_path = script != nullptr ? script->get_path() : String();
+
+    // What the instance lists beyond the declared properties depends on
+    // its state, Animation tracks or shader parameters for example.
+    LocalVector<StringName> properties;
+    read_properties(object, properties);
+    int64_t declared = _count_storage(ClassDBSingleton::get_singleton()->class_get_property_list(class_name));
+    if (script != nullptr) {
+        declared += _count_storage(script->get_script_property_list());
+    }
+    if (int64_t(properties.size()) != declared || object->has_method("_get_property_list")) {
+        entry->per_instance = true;
+        return entry;
+    }
+
+    MsgpackWriter writer;
+    entry->offsets.push_back(0);
+    for (const StringName &name : properties) {
+        CharString utf8 = String(name).utf8();
+        msgpack_core::write_str(writer, utf8.get_data(), utf8.length());
+        entry->offsets.push_back(writer.get_size());
+    }
+    entry->properties = properties;
+    entry->encoded_names = writer.finish();
+    return entry;
+}
+
+MsgpackObjectCache *MsgpackObjectCache::get_thread_cache() {
+    uint64_t generation = object_cache_generation.load(std::memory_order_acquire);
+    if (thread_object_cache.generation != generation) {
+        MsgpackObjectCache *cache = memnew(MsgpackObjectCache);
+        std::lock_guard<std::mutex> lock(object_cache_mutex);
+        object_caches.push_back(cache);
+        thread_object_cache.cache = cache;
+        thread_object_cache.generation = generation;
+    }
+    return thread_object_cache.cache;
+}
+
+void MsgpackObjectCache::free_thread_caches() {
+    std::lock_guard<std::mutex> lock(object_cache_mutex);
+    object_cache_generation.fetch_add(1, std::memory_order_release);
+    for (MsgpackObjectCache *cache : object_caches) {
+        memdelete(cache);
+    }
+    object_caches.clear();
+}
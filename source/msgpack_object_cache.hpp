@@ -0,0 +1,58 @@
+#ifndef MSGPACK_OBJECT_CACHE_HPP
+#define MSGPACK_OBJECT_CACHE_HPP
+
+#include <godot_cpp/classes/object.hpp>
+#include <godot_cpp/classes/script.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <godot_cpp/variant/string_name.hpp>
+
+namespace godot {
+    // Storage property names per class and script, with the packed name
+    // strings, built the first time an instance is packed. Classes whose
+    // instances list other properties than ClassDB and the script declare,
+    // through _get_property_list() or _validate_property(), are not cached
+    // and read from every instance. Every thread has a cache of its own, so
+    // lookups take no lock.
+    class MsgpackObjectCache {
+    public:
+        struct Entry {
+            String class_name;
+            uint64_t script_id = 0;
+            String script_path;
+            // Set when the properties have to be read per instance, the
+            // fields below are empty then.
+            bool per_instance = false;
+            LocalVector<StringName> properties;
+            // Packed names back to back, name i spans offsets[i]..offsets[i + 1].
+            PackedByteArray encoded_names;
+            LocalVector<int64_t> offsets;
+        };
+
+        ~MsgpackObjectCache();
+
+        // Entry for the class and script of object, nullptr if another
+        // class or script holds its slot.
+        const Entry *get(Object *object, const String& class_name);
+
+        // Storage properties listed by object itself, except the script,
+        // which is packed as a path next to the class name.
+        static void read_properties(Object *object, LocalVector<StringName> &properties);
+
+        // Cache of the calling thread, created on first use.
+        static MsgpackObjectCache *get_thread_cache();
+        // Frees the caches of all threads. Only safe while nothing is
+        // packing, threads create a new cache on their next use.
+        static void free_thread_caches();
+
+    private:
+        // Keyed on the class name hash and the script's instance id, a
+        // colliding class or script is read per instance.
+        HashMap<uint64_t, Entry *> entries;
+
+        static Entry *_build(Object *object, const String& class_name, Script *script);
+    };
+}
+
+#endif //MSGPACK_OBJECT_CACHE_HPP
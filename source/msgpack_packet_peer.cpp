@@ -0,0 +1,296 @@
+#include "msgpack_packet_peer.hpp"
+
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/core/class_db.hpp>
+
+using namespace godot;
+
+void MsgpackPacketPeer::set_peer(const Ref<RefCounted>& p_peer) {
+    packet_peer = Ref<PacketPeer>(Object::cast_to<PacketPeer>(p_peer.ptr()));
+    stream_peer = Ref<StreamPeer>(Object::cast_to<StreamPeer>(p_peer.ptr()));
+    ERR_FAIL_COND_MSG(p_peer.is_valid() && packet_peer.is_null() && stream_peer.is_null(), "Peer must be a PacketPeer or a StreamPeer.");
+
+    queued.clear();
+    received.clear();
+    received_read = 0;
+    stream_pending.clear();
+    stream_decoder.unref();
+}
+
+Ref<RefCounted> MsgpackPacketPeer::get_peer() const {
+    if (packet_peer.is_valid()) {
+        return packet_peer;
+    }
+    return stream_peer;
+}
+
+void MsgpackPacketPeer::set_framing(Framing p_framing) {
+    ERR_FAIL_COND_MSG(queued.get_size() > 0, "Flush queued values before changing the framing.");
+    framing = p_framing;
+}
+
+MsgpackPacketPeer::Framing MsgpackPacketPeer::get_framing() const {
+    return framing;
+}
+
+void MsgpackPacketPeer::set_mtu(int64_t p_mtu) {
+    ERR_FAIL_COND(p_mtu < 1);
+    mtu = p_mtu;
+}
+
+int64_t MsgpackPacketPeer::get_mtu() const {
+    return mtu;
+}
+
+void MsgpackPacketPeer::set_flush_delay_ms(int64_t p_delay) {
+    ERR_FAIL_COND(p_delay < 0);
+    flush_delay_ms = p_delay;
+}
+
+int64_t MsgpackPacketPeer::get_flush_delay_ms() const {
+    return flush_delay_ms;
+}
+
+void MsgpackPacketPeer::set_max_frame_size(int64_t p_size) {
+    ERR_FAIL_COND(p_size < 1 || p_size > UINT32_MAX);
+    max_frame_size = p_size;
+}
+
+int64_t MsgpackPacketPeer::get_max_frame_size() const {
+    return max_frame_size;
+}
+
+void MsgpackPacketPeer::set_flags(BitField<Msgpack::PackFlags> p_flags) {
+    // Values share packets, a compressed frame per value would not pay off.
+    queued.flags = uint32_t(int64_t(p_flags)) & ~uint32_t(Msgpack::PACK_COMPRESS);
+}
+
+BitField<Msgpack::PackFlags> MsgpackPacketPeer::get_flags() const {
+    return queued.flags;
+}
+
+Error MsgpackPacketPeer::put_value(const Variant& value) {
+    ERR_FAIL_COND_V_MSG(packet_peer.is_null() && stream_peer.is_null(), ERR_UNCONFIGURED, "No peer set.");
+    int64_t start = queued.get_size();
+    bool prefixed = framing == FRAMING_LENGTH_PREFIXED;
+    if (prefixed) {
+        queued.put_u32(0);
+    }
+    MsgpackError error;
+    Msgpack::_pack(value, queued, error);
+    if (error.failed()) {
+        queued.reset_to(start);
+        Msgpack::_print_error(error);
+        return error.code;
+    }
+    if (queued.get_size() - start - (prefixed ? 4 : 0) > max_frame_size) {
+        queued.truncate(start);
+        ERR_FAIL_V_MSG(ERR_OUT_OF_MEMORY, "Value larger than max_frame_size.");
+    }
+    if (prefixed) {
+        uint32_t length = uint32_t(queued.get_size() - start - 4);
+        uint8_t *header = queued.get_data_at(start);
+        header[0] = uint8_t(length >> 24);
+        header[1] = uint8_t(length >> 16);
+        header[2] = uint8_t(length >> 8);
+        header[3] = uint8_t(length);
+    }
+    if (start == 0) {
+        queued_since = Time::get_singleton()->get_ticks_msec();
+    }
+
+    Error err = OK;
+    int64_t size = queued.get_size();
+    if (start > 0 && size > mtu) {
+        // The new value does not fit the packet being filled, send what was
+        // queued before it and keep the value as the start of the next one.
+        err = _send(queued.get_data_at(0), start);
+        memmove(queued.get_data_at(0), queued.get_data_at(start), size - start);
+        queued.truncate(size - start);
+        queued_since = Time::get_singleton()->get_ticks_msec();
+    }
+    if (queued.get_size() >= mtu) {
+        Error flush_err = flush();
+        err = err != OK ? err : flush_err;
+    }
+    return err;
+}
+
+Error MsgpackPacketPeer::flush() {
+    if (queued.get_size() == 0) {
+        return OK;
+    }
+    Error err = _send(queued.get_data_at(0), queued.get_size());
+    queued.clear();
+    return err;
+}
+
+Error MsgpackPacketPeer::poll() {
+    Error err = OK;
+    if (queued.get_size() > 0 && Time::get_singleton()->get_ticks_msec() - queued_since >= uint64_t(flush_delay_ms)) {
+        err = flush();
+    }
+    Error receive_err = OK;
+    if (packet_peer.is_valid()) {
+        receive_err = _receive_packets();
+    } else if (stream_peer.is_valid()) {
+        receive_err = _receive_stream();
+    }
+    return err != OK ? err : receive_err;
+}
+
+int64_t MsgpackPacketPeer::get_available_value_count() const {
+    return received.size() - received_read;
+}
+
+Variant MsgpackPacketPeer::get_value() {
+    ERR_FAIL_COND_V_MSG(received_read >= received.size(), Variant(), "No received values available.");
+    Variant value = received[received_read];
+    received[received_read] = Variant();
+    received_read++;
+    if (received_read == received.size()) {
+        received.clear();
+        received_read = 0;
+    }
+    return value;
+}
+
+int64_t MsgpackPacketPeer::get_queued_size() const {
+    return queued.get_size();
+}
+
+void MsgpackPacketPeer::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("set_peer", "peer"), &MsgpackPacketPeer::set_peer);
+    ClassDB::bind_method(D_METHOD("get_peer"), &MsgpackPacketPeer::get_peer);
+    ClassDB::bind_method(D_METHOD("set_framing", "framing"), &MsgpackPacketPeer::set_framing);
+    ClassDB::bind_method(D_METHOD("get_framing"), &MsgpackPacketPeer::get_framing);
+    ClassDB::bind_method(D_METHOD("set_mtu", "mtu"), &MsgpackPacketPeer::set_mtu);
+    ClassDB::bind_method(D_METHOD("get_mtu"), &MsgpackPacketPeer::get_mtu);
+    ClassDB::bind_method(D_METHOD("set_flush_delay_ms", "delay"), &MsgpackPacketPeer::set_flush_delay_ms);
+    ClassDB::bind_method(D_METHOD("get_flush_delay_ms"), &MsgpackPacketPeer::get_flush_delay_ms);
+    ClassDB::bind_method(D_METHOD("set_max_frame_size", "size"), &MsgpackPacketPeer::set_max_frame_size);
+    ClassDB::bind_method(D_METHOD("get_max_frame_size"), &MsgpackPacketPeer::get_max_frame_size);
+    ClassDB::bind_method(D_METHOD("set_flags", "flags"), &MsgpackPacketPeer::set_flags);
+    ClassDB::bind_method(D_METHOD("get_flags"), &MsgpackPacketPeer::get_flags);
+    ClassDB::bind_method(D_METHOD("put_value", "value"), &MsgpackPacketPeer::put_value);
+    ClassDB::bind_method(D_METHOD("flush"), &MsgpackPacketPeer::flush);
+    ClassDB::bind_method(D_METHOD("poll"), &MsgpackPacketPeer::poll);
+    ClassDB::bind_method(D_METHOD("get_available_value_count"), &MsgpackPacketPeer::get_available_value_count);
+    ClassDB::bind_method(D_METHOD("get_value"), &MsgpackPacketPeer::get_value);
+    ClassDB::bind_method(D_METHOD("get_queued_size"), &MsgpackPacketPeer::get_queued_size);
+
+    ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "peer", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NONE), "set_peer", "get_peer");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "framing", PROPERTY_HINT_ENUM, "Length Prefixed,Concatenated"), "set_framing", "get_framing");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "mtu"), "set_mtu", "get_mtu");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "flush_delay_ms"), "set_flush_delay_ms", "get_flush_delay_ms");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_frame_size"), "set_max_frame_size", "get_max_frame_size");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "flags", PROPERTY_HINT_FLAGS, "Compact Numbers:1,Objects:4"), "set_flags", "get_flags");
+
+    BIND_ENUM_CONSTANT(FRAMING_LENGTH_PREFIXED);
+    BIND_ENUM_CONSTANT(FRAMING_CONCATENATED);
+}
+
+Error MsgpackPacketPeer::_send(const uint8_t *data, int64_t size) {
+    PackedByteArray packet;
+    packet.resize(size);
+    memcpy(packet.ptrw(), data, size);
+    if (packet_peer.is_valid()) {
+        return packet_peer->put_packet(packet);
+    }
+    return stream_peer->put_data(packet);
+}
+
+Error MsgpackPacketPeer::_receive_packets() {
+    while (packet_peer->get_available_packet_count() > 0) {
+        PackedByteArray packet = packet_peer->get_packet();
+        Error err = packet_peer->get_packet_error();
+        if (err != OK) {
+            return err;
+        }
+        _split(packet.ptr(), packet.size(), false, err);
+        if (err != OK) {
+            return err;
+        }
+    }
+    return OK;
+}
+
+Error MsgpackPacketPeer::_receive_stream() {
+    int32_t available = stream_peer->get_available_bytes();
+    if (available <= 0) {
+        return OK;
+    }
+    Array result = stream_peer->get_partial_data(available);
+    Error err = Error(int(result[0]));
+    if (err != OK) {
+        return err;
+    }
+    PackedByteArray data = result[1];
+
+    if (framing == FRAMING_CONCATENATED) {
+        if (stream_decoder.is_null()) {
+            stream_decoder.instantiate();
+        }
+        stream_decoder->set_max_value_size(max_frame_size);
+        Array values = stream_decoder->feed(data);
+        for (int64_t i = 0; i < values.size(); i++) {
+            received.push_back(values[i]);
+        }
+        // There is no telling where the next value starts after invalid
+        // data, drop what was buffered so later reads are not stuck on it.
+        err = stream_decoder->get_error();
+        if (err != OK) {
+            stream_decoder->reset();
+        }
+        return err;
+    }
+
+    stream_pending.append_array(data);
+    int64_t used = _split(stream_pending.ptr(), stream_pending.size(), true, err);
+    if (err != OK) {
+        stream_pending.clear();
+    } else if (used > 0) {
+        stream_pending = stream_pending.slice(used);
+    }
+    return err;
+}
+
+int64_t MsgpackPacketPeer::_split(const uint8_t *data, int64_t size, bool partial, Error &error) {
+    MsgpackReader reader(data, size);
+    while (reader.get_available() > 0) {
+        int64_t start = reader.get_position();
+        int64_t length = reader.get_available();
+        MsgpackError value_error;
+        if (framing == FRAMING_LENGTH_PREFIXED) {
+            if (reader.has(4)) {
+                length = reader.get_u32();
+            }
+            if (length > max_frame_size) {
+                value_error.set(Error::ERR_OUT_OF_MEMORY, start, "Frame larger than max_frame_size!");
+            } else if (reader.get_position() == start || !reader.has(length)) {
+                if (partial) {
+                    return start;
+                }
+                value_error.set(Error::ERR_FILE_EOF, start, "Truncated frame!");
+            }
+        }
+
+        Variant value;
+        MsgpackReader value_reader(reader.peek(), length);
+        if (!value_error.failed()) {
+            value = Msgpack::_unpack(value_reader, value_error);
+            value_error.offset += reader.get_position();
+        }
+        if (!value_error.failed() && framing == FRAMING_LENGTH_PREFIXED && value_reader.get_available() != 0) {
+            value_error.set(Error::ERR_INVALID_DATA, start, "Frame holds more than one value!");
+        }
+        if (value_error.failed()) {
+            Msgpack::_print_error(value_error);
+            error = value_error.code;
+            return start;
+        }
+        reader.get_data(value_reader.get_position());
+        received.push_back(value);
+    }
+    return reader.get_position();
+}
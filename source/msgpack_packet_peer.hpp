@@ -0,0 +1,82 @@
+#ifndef MSGPACK_PACKET_PEER_HPP
+#define MSGPACK_PACKET_PEER_HPP
+
+#include "msgpack.hpp"
+#include "msgpack_stream_decoder.hpp"
+
+#include <godot_cpp/classes/packet_peer.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/classes/stream_peer.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+namespace godot {
+    // Sends values over a PacketPeer or StreamPeer. Queued values share
+    // packets of up to mtu bytes, which go out when full, on flush(), or from
+    // poll() once the oldest value has waited flush_delay_ms. Received
+    // packets are split back into values.
+    class MsgpackPacketPeer : public RefCounted {
+        GDCLASS(MsgpackPacketPeer, RefCounted)
+
+    public:
+        enum Framing {
+            // Every value is preceded by its size as a big-endian u32.
+            FRAMING_LENGTH_PREFIXED,
+            // Values back to back, split by decoding them.
+            FRAMING_CONCATENATED,
+        };
+
+        void set_peer(const Ref<RefCounted>& p_peer);
+        Ref<RefCounted> get_peer() const;
+        void set_framing(Framing p_framing);
+        Framing get_framing() const;
+        void set_mtu(int64_t p_mtu);
+        int64_t get_mtu() const;
+        void set_flush_delay_ms(int64_t p_delay);
+        int64_t get_flush_delay_ms() const;
+        void set_max_frame_size(int64_t p_size);
+        int64_t get_max_frame_size() const;
+        void set_flags(BitField<Msgpack::PackFlags> p_flags);
+        BitField<Msgpack::PackFlags> get_flags() const;
+
+        Error put_value(const Variant& value);
+        Error flush();
+        Error poll();
+        int64_t get_available_value_count() const;
+        Variant get_value();
+        int64_t get_queued_size() const;
+
+    protected:
+        static void _bind_methods();
+
+    private:
+        Ref<PacketPeer> packet_peer;
+        Ref<StreamPeer> stream_peer;
+        Framing framing = FRAMING_LENGTH_PREFIXED;
+        int64_t mtu = 1200;
+        int64_t flush_delay_ms = 0;
+        // Largest value accepted, as a length prefix or as an incomplete
+        // concatenated value. Bounds what a peer can make us buffer.
+        int64_t max_frame_size = 1024 * 1024;
+
+        // Outgoing values not sent yet, queued_since is when the first arrived.
+        MsgpackWriter queued;
+        uint64_t queued_since = 0;
+
+        LocalVector<Variant> received;
+        uint32_t received_read = 0;
+        // Incomplete frame of a StreamPeer, the decoder takes concatenated ones.
+        PackedByteArray stream_pending;
+        Ref<MsgpackStreamDecoder> stream_decoder;
+
+        Error _send(const uint8_t *data, int64_t size);
+        Error _receive_packets();
+        Error _receive_stream();
+        // Decodes every complete frame in data and returns the bytes used,
+        // stopping at the first invalid one.
+        int64_t _split(const uint8_t *data, int64_t size, bool partial, Error &error);
+    };
+}
+
+VARIANT_ENUM_CAST(MsgpackPacketPeer::Framing);
+
+#endif //MSGPACK_PACKET_PEER_HPP
@@ -0,0 +1,25 @@
+#ifndef MSGPACK_READER_HPP
+#define MSGPACK_READER_HPP
+
+#include "msgpack_core.hpp"
+
+namespace godot {
+    class MsgpackKeyCache;
+
+    // Core buffer cursor plus the decode options of the binding.
+    class MsgpackReader : public msgpack_core::BufferReader {
+    public:
+        // Optional cache for decoded map keys, see MsgpackKeyCache.
+        MsgpackKeyCache *key_cache = nullptr;
+        // Msgpack::UnpackFlags applied by the decoder.
+        uint32_t flags = 0;
+        // Containers being decoded around the current position, the decoder
+        // fails once this reaches Msgpack.max_depth.
+        int64_t depth = 0;
+
+        MsgpackReader(const uint8_t *p_data, int64_t p_size) :
+                msgpack_core::BufferReader(p_data, p_size) {}
+    };
+}
+
+#endif //MSGPACK_READER_HPP
@@ -0,0 +1,215 @@
+#include "msgpack_schema.hpp"
+
+#include "msgpack.hpp"
+
+#include <godot_cpp/core/class_db.hpp>
+
+using namespace godot;
+
+void MsgpackSchema::set_keys(const Array& p_keys) {
+    MsgpackWriter writer;
+    MsgpackError error;
+
+    key_offsets.resize(p_keys.size() + 1);
+    key_offsets[0] = 0;
+    for (int64_t i = 0; i < p_keys.size(); i++) {
+        // Messages are matched on key bytes, a repeated key would never be
+        // told apart from its first use.
+        if (p_keys.find(p_keys[i]) != i) {
+            error.set(Error::ERR_INVALID_PARAMETER, writer.get_size(), "Duplicate key in schema!");
+        } else {
+            Msgpack::_pack(p_keys[i], writer, error);
+        }
+        if (error.failed()) {
+            Msgpack::_print_error(error);
+            keys = Array();
+            encoded_keys = PackedByteArray();
+            key_offsets.clear();
+            return;
+        }
+        key_offsets[i + 1] = writer.get_size();
+    }
+    keys = p_keys.duplicate();
+    encoded_keys = writer.finish();
+}
+
+Array MsgpackSchema::get_keys() const {
+    return keys.duplicate();
+}
+
+void MsgpackSchema::set_types(const PackedInt32Array& p_types) {
+    types = p_types;
+}
+
+PackedInt32Array MsgpackSchema::get_types() const {
+    return types;
+}
+
+void MsgpackSchema::set_positional(bool p_positional) {
+    positional = p_positional;
+}
+
+bool MsgpackSchema::is_positional() const {
+    return positional;
+}
+
+PackedByteArray MsgpackSchema::pack(const Dictionary& data) const {
+    int64_t count = keys.size();
+    MsgpackWriter writer(5 + encoded_keys.size() + count * 9);
+    MsgpackError error;
+
+    if (!types.is_empty() && types.size() != count) {
+        error.set(Error::ERR_UNCONFIGURED, 0, "Schema types do not match its keys!");
+    } else if (positional) {
+        Msgpack::_pack_array_header(writer, count, error);
+    } else {
+        Msgpack::_pack_map_header(writer, count, error);
+    }
+    const uint8_t *key_data = encoded_keys.ptr();
+    for (int64_t i = 0; i < count && !error.failed(); i++) {
+        if (!data.has(keys[i])) {
+            error.set(Error::ERR_INVALID_DATA, writer.get_size(), "Dictionary is missing a schema key!");
+            break;
+        }
+        Variant value = data[keys[i]];
+        if (!_check_type(i, value)) {
+            error.set(Error::ERR_INVALID_DATA, writer.get_size(), "Value does not match the schema type!");
+            break;
+        }
+        if (!positional) {
+            writer.put_data(key_data + key_offsets[i], key_offsets[i + 1] - key_offsets[i]);
+        }
+        Msgpack::_pack(value, writer, error);
+    }
+
+    if (error.failed()) {
+        Msgpack::_print_error(error);
+        return PackedByteArray();
+    }
+    return writer.finish();
+}
+
+Dictionary MsgpackSchema::unpack(const PackedByteArray& data) const {
+    MsgpackReader reader(data.ptr(), data.size());
+    MsgpackError error;
+    Dictionary result;
+    Variant value;
+    int64_t size = 0;
+
+    Msgpack::Token token = Msgpack::_unpack_token(reader, value, size, error);
+    if (error.failed()) {
+        Msgpack::_print_error(error);
+        return Dictionary();
+    }
+
+    if (!types.is_empty() && types.size() != keys.size()) {
+        error.set(Error::ERR_UNCONFIGURED, 0, "Schema types do not match its keys!");
+    } else if (positional) {
+        if (token != Msgpack::TOKEN_ARRAY || size != keys.size()) {
+            error.set(Error::ERR_INVALID_DATA, 0, "Message does not match the schema!");
+        }
+        for (int64_t i = 0; i < size && !error.failed(); i++) {
+            int64_t start = reader.get_position();
+            Variant v = Msgpack::_unpack(reader, error);
+            if (!error.failed() && !_check_type(i, v)) {
+                error.set(Error::ERR_INVALID_DATA, start, "Value does not match the schema type!");
+            }
+            result[keys[i]] = v;
+        }
+    } else {
+        if (token != Msgpack::TOKEN_MAP || size != keys.size()) {
+            error.set(Error::ERR_INVALID_DATA, 0, "Message does not match the schema!");
+        }
+        // With as many entries as keys and none repeated, every key is there.
+        LocalVector<bool> seen;
+        seen.resize(error.failed() ? 0 : size);
+        for (uint32_t i = 0; i < seen.size(); i++) {
+            seen[i] = false;
+        }
+        for (int64_t i = 0; i < size && !error.failed(); i++) {
+            // Keys are matched on their packed bytes and reuse the schema's
+            // key Variant. Others are decoded in case they were packed in a
+            // different but equal form.
+            int64_t key_start = reader.get_position();
+            int64_t index = _match_key(reader, i);
+            if (index < 0) {
+                Variant k = Msgpack::_unpack(reader, error);
+                index = error.failed() ? -1 : keys.find(k);
+                if (index < 0 && !error.failed()) {
+                    error.set(Error::ERR_INVALID_DATA, key_start, "Key not in the schema!");
+                }
+            }
+            if (error.failed()) {
+                break;
+            }
+            if (seen[index]) {
+                error.set(Error::ERR_INVALID_DATA, key_start, "Duplicate key in message!");
+                break;
+            }
+            seen[index] = true;
+            int64_t start = reader.get_position();
+            Variant v = Msgpack::_unpack(reader, error);
+            if (!error.failed() && !_check_type(index, v)) {
+                error.set(Error::ERR_INVALID_DATA, start, "Value does not match the schema type!");
+            }
+            result[keys[index]] = v;
+        }
+    }
+
+    if (!error.failed() && reader.get_available() > 0) {
+        error.set(Error::ERR_INVALID_DATA, reader.get_position(), "Trailing data after the message!");
+    }
+
+    if (error.failed()) {
+        Msgpack::_print_error(error);
+        return Dictionary();
+    }
+    return result;
+}
+
+int64_t MsgpackSchema::_match_key(MsgpackReader &reader, int64_t hint) const {
+    int64_t count = keys.size();
+    const uint8_t *key_data = encoded_keys.ptr();
+
+    // Keys usually arrive in schema order, so start at the expected one.
+    for (int64_t n = 0; n < count; n++) {
+        int64_t i = (hint + n) % count;
+        int64_t length = key_offsets[i + 1] - key_offsets[i];
+        if (reader.has(length) && memcmp(reader.peek(), key_data + key_offsets[i], length) == 0) {
+            reader.get_data(length);
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool MsgpackSchema::_check_type(int64_t i, Variant &value) const {
+    if (types.is_empty() || types[i] == Variant::NIL || value.get_type() == types[i]) {
+        return true;
+    }
+    // Names and paths are packed as plain strings.
+    if (value.get_type() == Variant::STRING && types[i] == Variant::STRING_NAME) {
+        value = StringName(value.operator String());
+        return true;
+    }
+    if (value.get_type() == Variant::STRING && types[i] == Variant::NODE_PATH) {
+        value = NodePath(value.operator String());
+        return true;
+    }
+    return false;
+}
+
+void MsgpackSchema::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("set_keys", "keys"), &MsgpackSchema::set_keys);
+    ClassDB::bind_method(D_METHOD("get_keys"), &MsgpackSchema::get_keys);
+    ClassDB::bind_method(D_METHOD("set_types", "types"), &MsgpackSchema::set_types);
+    ClassDB::bind_method(D_METHOD("get_types"), &MsgpackSchema::get_types);
+    ClassDB::bind_method(D_METHOD("set_positional", "positional"), &MsgpackSchema::set_positional);
+    ClassDB::bind_method(D_METHOD("is_positional"), &MsgpackSchema::is_positional);
+    ClassDB::bind_method(D_METHOD("pack", "data"), &MsgpackSchema::pack);
+    ClassDB::bind_method(D_METHOD("unpack", "data"), &MsgpackSchema::unpack);
+
+    ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "keys"), "set_keys", "get_keys");
+    ADD_PROPERTY(PropertyInfo(Variant::PACKED_INT32_ARRAY, "types"), "set_types", "get_types");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "positional"), "set_positional", "is_positional");
+}
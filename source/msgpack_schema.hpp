@@ -0,0 +1,48 @@
+#ifndef MSGPACK_SCHEMA_HPP
+#define MSGPACK_SCHEMA_HPP
+
+#include "msgpack_reader.hpp"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+namespace godot {
+    // Encoder/decoder for dictionaries with a fixed set of keys. Keys are
+    // packed once when the schema is set up, messages then either carry the
+    // cached key bytes (map mode) or only the values in key order (positional
+    // mode). Optional per-key types are checked on both sides.
+    class MsgpackSchema : public RefCounted {
+        GDCLASS(MsgpackSchema, RefCounted)
+
+    public:
+        void set_keys(const Array& p_keys);
+        Array get_keys() const;
+        void set_types(const PackedInt32Array& p_types);
+        PackedInt32Array get_types() const;
+        void set_positional(bool p_positional);
+        bool is_positional() const;
+
+        PackedByteArray pack(const Dictionary& data) const;
+        Dictionary unpack(const PackedByteArray& data) const;
+
+    protected:
+        static void _bind_methods();
+
+    private:
+        Array keys;
+        // Packed keys back to back, key i spans key_offsets[i]..key_offsets[i + 1].
+        PackedByteArray encoded_keys;
+        LocalVector<int64_t> key_offsets;
+        // Variant::Type of the value for each key, TYPE_NIL takes any value.
+        // Empty when values are not checked.
+        PackedInt32Array types;
+        bool positional = false;
+
+        int64_t _match_key(MsgpackReader &reader, int64_t hint) const;
+        // Checks value against the type of key i. Strings decoded for a
+        // StringName or NodePath key are converted first.
+        bool _check_type(int64_t i, Variant &value) const;
+    };
+}
+
+#endif //MSGPACK_SCHEMA_HPP
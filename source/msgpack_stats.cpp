@@ -0,0 +1,83 @@
+#include "msgpack_stats.hpp"
+
+#include <chrono>
+
+using namespace godot;
+
+static uint64_t _get_ticks_usec() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static Dictionary _histogram(const std::atomic<uint64_t> *counts) {
+    Dictionary res;
+    for (int i = 0; i < Variant::VARIANT_MAX; i++) {
+        uint64_t count = counts[i].load(std::memory_order_relaxed);
+        if (count > 0) {
+            res[Variant::get_type_name(Variant::Type(i))] = int64_t(count);
+        }
+    }
+    return res;
+}
+
+MsgpackStats::Sample MsgpackStats::begin() const {
+    Sample sample;
+    if (is_enabled()) {
+        sample.active = true;
+        sample.start = _get_ticks_usec();
+    }
+    return sample;
+}
+
+void MsgpackStats::end_pack(const Sample &sample, int64_t bytes, bool failed) {
+    if (!sample.active) {
+        return;
+    }
+    pack_calls.fetch_add(1, std::memory_order_relaxed);
+    pack_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    pack_usec.fetch_add(_get_ticks_usec() - sample.start, std::memory_order_relaxed);
+    if (failed) {
+        pack_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void MsgpackStats::end_unpack(const Sample &sample, int64_t bytes, bool failed) {
+    if (!sample.active) {
+        return;
+    }
+    unpack_calls.fetch_add(1, std::memory_order_relaxed);
+    unpack_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    unpack_usec.fetch_add(_get_ticks_usec() - sample.start, std::memory_order_relaxed);
+    if (failed) {
+        unpack_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void MsgpackStats::reset() {
+    pack_calls.store(0);
+    pack_bytes.store(0);
+    pack_usec.store(0);
+    pack_errors.store(0);
+    unpack_calls.store(0);
+    unpack_bytes.store(0);
+    unpack_usec.store(0);
+    unpack_errors.store(0);
+    for (int i = 0; i < Variant::VARIANT_MAX; i++) {
+        pack_types[i].store(0);
+        unpack_types[i].store(0);
+    }
+}
+
+Dictionary MsgpackStats::to_dictionary() const {
+    Dictionary res;
+    res["pack_calls"] = int64_t(pack_calls.load());
+    res["pack_bytes"] = int64_t(pack_bytes.load());
+    res["pack_usec"] = int64_t(pack_usec.load());
+    res["pack_errors"] = int64_t(pack_errors.load());
+    res["pack_types"] = _histogram(pack_types);
+    res["unpack_calls"] = int64_t(unpack_calls.load());
+    res["unpack_bytes"] = int64_t(unpack_bytes.load());
+    res["unpack_usec"] = int64_t(unpack_usec.load());
+    res["unpack_errors"] = int64_t(unpack_errors.load());
+    res["unpack_types"] = _histogram(unpack_types);
+    return res;
+}
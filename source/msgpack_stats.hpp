@@ -0,0 +1,70 @@
+#ifndef MSGPACK_STATS_HPP
+#define MSGPACK_STATS_HPP
+
+#include <godot_cpp/core/defs.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/variant.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+namespace godot {
+    // Codec counters, updated from any thread with relaxed atomics. Only
+    // compiled in with MSGPACK_STATS and only updated while enabled.
+    class MsgpackStats {
+    public:
+        struct Sample {
+            bool active = false;
+            uint64_t start = 0;
+        };
+
+        std::atomic<bool> enabled = { false };
+
+        std::atomic<uint64_t> pack_calls = { 0 };
+        std::atomic<uint64_t> pack_bytes = { 0 };
+        std::atomic<uint64_t> pack_usec = { 0 };
+        std::atomic<uint64_t> pack_errors = { 0 };
+        std::atomic<uint64_t> unpack_calls = { 0 };
+        std::atomic<uint64_t> unpack_bytes = { 0 };
+        std::atomic<uint64_t> unpack_usec = { 0 };
+        std::atomic<uint64_t> unpack_errors = { 0 };
+        std::atomic<uint64_t> pack_types[Variant::VARIANT_MAX] = {};
+        std::atomic<uint64_t> unpack_types[Variant::VARIANT_MAX] = {};
+
+        _FORCE_INLINE_ bool is_enabled() const {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        Sample begin() const;
+        void end_pack(const Sample &sample, int64_t bytes, bool failed);
+        void end_unpack(const Sample &sample, int64_t bytes, bool failed);
+        void reset();
+        Dictionary to_dictionary() const;
+    };
+}
+
+#ifdef MSGPACK_STATS
+#define MSGPACK_STATS_BEGIN(m_sample) const MsgpackStats::Sample m_sample = Msgpack::stats.begin()
+#define MSGPACK_STATS_END_PACK(m_sample, m_bytes, m_failed) Msgpack::stats.end_pack(m_sample, m_bytes, m_failed)
+#define MSGPACK_STATS_END_UNPACK(m_sample, m_bytes, m_failed) Msgpack::stats.end_unpack(m_sample, m_bytes, m_failed)
+#define MSGPACK_STATS_TYPE(m_histogram, m_type)                                             \
+    do {                                                                                    \
+        if (unlikely(Msgpack::stats.is_enabled())) {                                        \
+            Msgpack::stats.m_histogram[m_type].fetch_add(1, std::memory_order_relaxed);     \
+        }                                                                                   \
+    } while (0)
+#define MSGPACK_STATS_TYPES(m_histogram, m_type, m_count)                                   \
+    do {                                                                                    \
+        if (unlikely(Msgpack::stats.is_enabled())) {                                        \
+            Msgpack::stats.m_histogram[m_type].fetch_add(m_count, std::memory_order_relaxed); \
+        }                                                                                   \
+    } while (0)
+#else
+#define MSGPACK_STATS_BEGIN(m_sample)
+#define MSGPACK_STATS_END_PACK(m_sample, m_bytes, m_failed) do { } while (0)
+#define MSGPACK_STATS_END_UNPACK(m_sample, m_bytes, m_failed) do { } while (0)
+#define MSGPACK_STATS_TYPE(m_histogram, m_type) do { } while (0)
+#define MSGPACK_STATS_TYPES(m_histogram, m_type, m_count) do { } while (0)
+#endif
+
+#endif //MSGPACK_STATS_HPP
@@ -0,0 +1,189 @@
+#include "msgpack_stream_decoder.hpp"
+
+#include "msgpack.hpp"
+
+#include <godot_cpp/core/class_db.hpp>
+
+using namespace godot;
+
+Array MsgpackStreamDecoder::feed(const PackedByteArray& data) {
+    Array messages;
+    if (error.failed()) {
+        return messages;
+    }
+
+    // Leftover bytes of an incomplete value are parsed together with the new
+    // data, otherwise the input is read in place.
+    bool use_pending = !pending.is_empty();
+    if (use_pending) {
+        pending.append_array(data);
+    }
+    const PackedByteArray &input = use_pending ? pending : data;
+    MsgpackReader reader(input.ptr(), input.size());
+    int64_t consumed = 0;
+
+    while (reader.get_available() > 0) {
+        Variant value;
+        int64_t size = 0;
+        MsgpackError token_error;
+        if (stack.size() == 0) {
+            value_start = pending_offset + reader.get_position();
+        }
+
+        if (intern_keys && _expects_key() && key_cache.unpack_key(reader, value)) {
+            consumed = reader.get_position();
+            _complete(value, messages);
+            continue;
+        }
+
+        Msgpack::Token token = Msgpack::_unpack_token(reader, value, size, token_error);
+        if (token_error.failed()) {
+            if (token_error.code != Error::ERR_FILE_EOF) {
+                error = token_error;
+                error.offset += pending_offset;
+            }
+            break;
+        }
+        if (token != Msgpack::TOKEN_VALUE && size > 0 && int64_t(stack.size()) >= Msgpack::max_depth.load(std::memory_order_relaxed)) {
+            error.set(Error::ERR_INVALID_DATA, pending_offset + consumed, "Maximum nesting depth exceeded!");
+            break;
+        }
+        consumed = reader.get_position();
+
+        if (token == Msgpack::TOKEN_ARRAY) {
+            if (size > 0) {
+                Frame frame;
+                frame.remaining = size;
+                stack.push_back(frame);
+                continue;
+            }
+            value = Array();
+        } else if (token == Msgpack::TOKEN_MAP) {
+            if (size > 0) {
+                Frame frame;
+                frame.remaining = size;
+                frame.is_map = true;
+                stack.push_back(frame);
+                continue;
+            }
+            value = Dictionary();
+        }
+        _complete(value, messages);
+    }
+
+    if (consumed == input.size()) {
+        pending.clear();
+    } else if (consumed > 0 || !use_pending) {
+        pending = input.slice(consumed);
+    }
+    pending_offset += consumed;
+
+    // Bytes from the start of the incomplete value up to the end of the
+    // input, whether still buffered or already in containers on the stack.
+    int64_t incomplete = stack.size() > 0 || !pending.is_empty() ? pending_offset + pending.size() - value_start : 0;
+    if (!error.failed() && max_value_size > 0 && incomplete > max_value_size) {
+        error.set(Error::ERR_OUT_OF_MEMORY, value_start, "Value larger than max_value_size!");
+        stack.clear();
+        pending.clear();
+    }
+    return messages;
+}
+
+bool MsgpackStreamDecoder::_expects_key() const {
+    return stack.size() > 0 && stack[stack.size() - 1].is_map && !stack[stack.size() - 1].has_key;
+}
+
+void MsgpackStreamDecoder::_complete(Variant value, Array &messages) {
+    while (stack.size() > 0) {
+        Frame &top = stack[stack.size() - 1];
+        if (top.is_map) {
+            if (!top.has_key) {
+                top.key = value;
+                top.has_key = true;
+                return;
+            }
+            top.dictionary[top.key] = value;
+            top.key = Variant();
+            top.has_key = false;
+        } else {
+            top.array.append(value);
+        }
+
+        top.remaining -= 1;
+        if (top.remaining > 0) {
+            return;
+        }
+        if (top.is_map) {
+            value = top.dictionary;
+        } else {
+            value = top.array;
+        }
+        stack.resize(stack.size() - 1);
+    }
+    messages.append(value);
+}
+
+void MsgpackStreamDecoder::reset() {
+    stack.clear();
+    pending.clear();
+    pending_offset = 0;
+    value_start = 0;
+    error = MsgpackError();
+}
+
+void MsgpackStreamDecoder::set_intern_keys(bool p_enabled) {
+    intern_keys = p_enabled;
+    if (!intern_keys) {
+        key_cache.clear();
+    }
+}
+
+bool MsgpackStreamDecoder::is_intern_keys() const {
+    return intern_keys;
+}
+
+void MsgpackStreamDecoder::set_max_value_size(int64_t p_size) {
+    ERR_FAIL_COND(p_size < 0);
+    max_value_size = p_size;
+}
+
+int64_t MsgpackStreamDecoder::get_max_value_size() const {
+    return max_value_size;
+}
+
+int64_t MsgpackStreamDecoder::get_buffered_size() const {
+    return pending.size();
+}
+
+int64_t MsgpackStreamDecoder::get_depth() const {
+    return stack.size();
+}
+
+Error MsgpackStreamDecoder::get_error() const {
+    return error.code;
+}
+
+int64_t MsgpackStreamDecoder::get_error_offset() const {
+    return error.offset;
+}
+
+String MsgpackStreamDecoder::get_error_message() const {
+    return error.message;
+}
+
+void MsgpackStreamDecoder::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("feed", "data"), &MsgpackStreamDecoder::feed);
+    ClassDB::bind_method(D_METHOD("reset"), &MsgpackStreamDecoder::reset);
+    ClassDB::bind_method(D_METHOD("get_buffered_size"), &MsgpackStreamDecoder::get_buffered_size);
+    ClassDB::bind_method(D_METHOD("get_depth"), &MsgpackStreamDecoder::get_depth);
+    ClassDB::bind_method(D_METHOD("get_error"), &MsgpackStreamDecoder::get_error);
+    ClassDB::bind_method(D_METHOD("get_error_offset"), &MsgpackStreamDecoder::get_error_offset);
+    ClassDB::bind_method(D_METHOD("get_error_message"), &MsgpackStreamDecoder::get_error_message);
+    ClassDB::bind_method(D_METHOD("set_intern_keys", "enabled"), &MsgpackStreamDecoder::set_intern_keys);
+    ClassDB::bind_method(D_METHOD("is_intern_keys"), &MsgpackStreamDecoder::is_intern_keys);
+    ClassDB::bind_method(D_METHOD("set_max_value_size", "size"), &MsgpackStreamDecoder::set_max_value_size);
+    ClassDB::bind_method(D_METHOD("get_max_value_size"), &MsgpackStreamDecoder::get_max_value_size);
+
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "intern_keys"), "set_intern_keys", "is_intern_keys");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_value_size"), "set_max_value_size", "get_max_value_size");
+}
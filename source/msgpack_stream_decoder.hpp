@@ -0,0 +1,62 @@
+#ifndef MSGPACK_STREAM_DECODER_HPP
+#define MSGPACK_STREAM_DECODER_HPP
+
+#include "msgpack_error.hpp"
+#include "msgpack_key_cache.hpp"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+namespace godot {
+    // Incremental decoder for msgpack values arriving in arbitrary chunks.
+    // Containers under construction are kept on an explicit stack, so only the
+    // bytes of a single incomplete scalar are ever held back between feeds.
+    // max_value_size bounds what one top-level value may take while it is
+    // incomplete.
+    class MsgpackStreamDecoder : public RefCounted {
+        GDCLASS(MsgpackStreamDecoder, RefCounted)
+
+    public:
+        Array feed(const PackedByteArray& data);
+        void reset();
+        void set_intern_keys(bool p_enabled);
+        bool is_intern_keys() const;
+        void set_max_value_size(int64_t p_size);
+        int64_t get_max_value_size() const;
+
+        int64_t get_buffered_size() const;
+        int64_t get_depth() const;
+        Error get_error() const;
+        int64_t get_error_offset() const;
+        String get_error_message() const;
+
+    protected:
+        static void _bind_methods();
+
+    private:
+        struct Frame {
+            Array array;
+            Dictionary dictionary;
+            Variant key;
+            int64_t remaining = 0;
+            bool is_map = false;
+            bool has_key = false;
+        };
+
+        LocalVector<Frame> stack;
+        PackedByteArray pending;
+        int64_t pending_offset = 0;
+        MsgpackError error;
+        MsgpackKeyCache key_cache;
+        bool intern_keys = false;
+        // 0 for no limit.
+        int64_t max_value_size = 0;
+        // Stream offset where the top-level value being decoded starts.
+        int64_t value_start = 0;
+
+        bool _expects_key() const;
+        void _complete(Variant value, Array &messages);
+    };
+}
+
+#endif //MSGPACK_STREAM_DECODER_HPP
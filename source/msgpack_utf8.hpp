@@ -0,0 +1,211 @@
+#ifndef MSGPACK_UTF8_HPP
+#define MSGPACK_UTF8_HPP
+
+#include "msgpack_byteswap.hpp"
+
+#include <cstdint>
+
+// Conversion between Godot's UTF-32 String storage and UTF-8, with 16
+// character blocks of ASCII handled as a whole. Characters that cannot be
+// encoded become U+FFFD like in String::utf8(). The decoder rejects what it
+// cannot convert exactly as String::utf8() would, so callers can fall back
+// to it: malformed sequences, overlong forms, surrogates and NUL bytes.
+
+// Checks that the 16 characters at p_src are ASCII.
+static inline bool msgpack_utf8_ascii_block(const char32_t *p_src) {
+#if defined(MSGPACK_SIMD_SSE2)
+    __m128i any = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128((const __m128i *)p_src), _mm_loadu_si128((const __m128i *)(p_src + 4))),
+            _mm_or_si128(_mm_loadu_si128((const __m128i *)(p_src + 8)), _mm_loadu_si128((const __m128i *)(p_src + 12))));
+    any = _mm_and_si128(any, _mm_set1_epi32(~0x7F));
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(any, _mm_setzero_si128())) == 0xFFFF;
+#elif defined(MSGPACK_SIMD_NEON)
+    const uint32_t *p = (const uint32_t *)p_src;
+    uint32x4_t any = vorrq_u32(vorrq_u32(vld1q_u32(p), vld1q_u32(p + 4)), vorrq_u32(vld1q_u32(p + 8), vld1q_u32(p + 12)));
+    uint32x2_t half = vorr_u32(vget_low_u32(any), vget_high_u32(any));
+    return ((vget_lane_u32(half, 0) | vget_lane_u32(half, 1)) & ~uint32_t(0x7F)) == 0;
+#else
+    uint32_t any = 0;
+    for (int i = 0; i < 16; i++) {
+        any |= uint32_t(p_src[i]);
+    }
+    return (any & ~uint32_t(0x7F)) == 0;
+#endif
+}
+
+// Narrows 16 ASCII characters to bytes.
+static inline void msgpack_utf8_narrow_block(uint8_t *p_dst, const char32_t *p_src) {
+#if defined(MSGPACK_SIMD_SSE2)
+    __m128i low = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)p_src), _mm_loadu_si128((const __m128i *)(p_src + 4)));
+    __m128i high = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(p_src + 8)), _mm_loadu_si128((const __m128i *)(p_src + 12)));
+    _mm_storeu_si128((__m128i *)p_dst, _mm_packus_epi16(low, high));
+#elif defined(MSGPACK_SIMD_NEON)
+    const uint32_t *p = (const uint32_t *)p_src;
+    uint16x8_t low = vcombine_u16(vmovn_u32(vld1q_u32(p)), vmovn_u32(vld1q_u32(p + 4)));
+    uint16x8_t high = vcombine_u16(vmovn_u32(vld1q_u32(p + 8)), vmovn_u32(vld1q_u32(p + 12)));
+    vst1q_u8(p_dst, vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+#else
+    for (int i = 0; i < 16; i++) {
+        p_dst[i] = uint8_t(p_src[i]);
+    }
+#endif
+}
+
+// Widens 16 bytes to characters if they are all ASCII and not NUL.
+static inline bool msgpack_utf8_widen_block(char32_t *p_dst, const uint8_t *p_src) {
+#if defined(MSGPACK_SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128((const __m128i *)p_src);
+    if (_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero))) != 0) {
+        return false;
+    }
+    __m128i low = _mm_unpacklo_epi8(v, zero);
+    __m128i high = _mm_unpackhi_epi8(v, zero);
+    _mm_storeu_si128((__m128i *)p_dst, _mm_unpacklo_epi16(low, zero));
+    _mm_storeu_si128((__m128i *)(p_dst + 4), _mm_unpackhi_epi16(low, zero));
+    _mm_storeu_si128((__m128i *)(p_dst + 8), _mm_unpacklo_epi16(high, zero));
+    _mm_storeu_si128((__m128i *)(p_dst + 12), _mm_unpackhi_epi16(high, zero));
+    return true;
+#elif defined(MSGPACK_SIMD_NEON)
+    uint8x16_t v = vld1q_u8(p_src);
+    uint64x2_t bad = vreinterpretq_u64_u8(vorrq_u8(vshrq_n_u8(v, 7), vceqq_u8(v, vdupq_n_u8(0))));
+    if ((vgetq_lane_u64(bad, 0) | vgetq_lane_u64(bad, 1)) != 0) {
+        return false;
+    }
+    uint32_t *p = (uint32_t *)p_dst;
+    uint16x8_t low = vmovl_u8(vget_low_u8(v));
+    uint16x8_t high = vmovl_u8(vget_high_u8(v));
+    vst1q_u32(p, vmovl_u16(vget_low_u16(low)));
+    vst1q_u32(p + 4, vmovl_u16(vget_high_u16(low)));
+    vst1q_u32(p + 8, vmovl_u16(vget_low_u16(high)));
+    vst1q_u32(p + 12, vmovl_u16(vget_high_u16(high)));
+    return true;
+#else
+    for (int i = 0; i < 16; i++) {
+        if (p_src[i] == 0 || p_src[i] >= 0x80) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        p_dst[i] = p_src[i];
+    }
+    return true;
+#endif
+}
+
+static inline bool msgpack_utf8_is_invalid(uint32_t p_char) {
+    return (p_char >= 0xD800 && p_char <= 0xDFFF) || p_char > 0x10FFFF;
+}
+
+// Returns the number of bytes msgpack_utf8_encode writes for p_count characters.
+static inline int64_t msgpack_utf8_length(const char32_t *p_src, int64_t p_count) {
+    int64_t length = 0;
+    int64_t i = 0;
+    while (i < p_count) {
+        if (i + 16 <= p_count && msgpack_utf8_ascii_block(p_src + i)) {
+            length += 16;
+            i += 16;
+            continue;
+        }
+        uint32_t c = p_src[i++];
+        if (c < 0x80) {
+            length += 1;
+        } else if (c < 0x800) {
+            length += 2;
+        } else if (c < 0x10000 || msgpack_utf8_is_invalid(c)) {
+            length += 3;
+        } else {
+            length += 4;
+        }
+    }
+    return length;
+}
+
+static inline void msgpack_utf8_encode(uint8_t *p_dst, const char32_t *p_src, int64_t p_count) {
+    int64_t i = 0;
+    while (i < p_count) {
+        if (i + 16 <= p_count && msgpack_utf8_ascii_block(p_src + i)) {
+            msgpack_utf8_narrow_block(p_dst, p_src + i);
+            p_dst += 16;
+            i += 16;
+            continue;
+        }
+        uint32_t c = p_src[i++];
+        if (msgpack_utf8_is_invalid(c)) {
+            c = 0xFFFD;
+        }
+        if (c < 0x80) {
+            *p_dst++ = uint8_t(c);
+        } else if (c < 0x800) {
+            *p_dst++ = uint8_t(0xC0 | (c >> 6));
+            *p_dst++ = uint8_t(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            *p_dst++ = uint8_t(0xE0 | (c >> 12));
+            *p_dst++ = uint8_t(0x80 | ((c >> 6) & 0x3F));
+            *p_dst++ = uint8_t(0x80 | (c & 0x3F));
+        } else {
+            *p_dst++ = uint8_t(0xF0 | (c >> 18));
+            *p_dst++ = uint8_t(0x80 | ((c >> 12) & 0x3F));
+            *p_dst++ = uint8_t(0x80 | ((c >> 6) & 0x3F));
+            *p_dst++ = uint8_t(0x80 | (c & 0x3F));
+        }
+    }
+}
+
+// Decodes p_length bytes into p_dst, which needs room for p_length
+// characters. Returns the number of characters, or -1 if the input has to
+// go through String::utf8() instead.
+static inline int64_t msgpack_utf8_decode(char32_t *p_dst, const uint8_t *p_src, int64_t p_length) {
+    int64_t count = 0;
+    int64_t i = 0;
+    while (i < p_length) {
+        if (i + 16 <= p_length && msgpack_utf8_widen_block(p_dst + count, p_src + i)) {
+            count += 16;
+            i += 16;
+            continue;
+        }
+        uint32_t c = p_src[i];
+        int64_t extra;
+        uint32_t min;
+        if (c < 0x80) {
+            if (c == 0) {
+                return -1;
+            }
+            p_dst[count++] = c;
+            i++;
+            continue;
+        } else if ((c & 0xE0) == 0xC0) {
+            extra = 1;
+            c &= 0x1F;
+            min = 0x80;
+        } else if ((c & 0xF0) == 0xE0) {
+            extra = 2;
+            c &= 0x0F;
+            min = 0x800;
+        } else if ((c & 0xF8) == 0xF0) {
+            extra = 3;
+            c &= 0x07;
+            min = 0x10000;
+        } else {
+            return -1;
+        }
+        if (p_length - i <= extra) {
+            return -1;
+        }
+        for (int64_t k = 1; k <= extra; k++) {
+            uint8_t b = p_src[i + k];
+            if ((b & 0xC0) != 0x80) {
+                return -1;
+            }
+            c = (c << 6) | (b & 0x3F);
+        }
+        if (c < min || msgpack_utf8_is_invalid(c)) {
+            return -1;
+        }
+        p_dst[count++] = c;
+        i += extra + 1;
+    }
+    return count;
+}
+
+#endif //MSGPACK_UTF8_HPP
@@ -0,0 +1,290 @@
+#include "msgpack_view.hpp"
+
+#include <godot_cpp/core/class_db.hpp>
+
+using namespace godot;
+
+void MsgpackView::set_data(const PackedByteArray& p_data) {
+    _open(p_data, 0);
+}
+
+PackedByteArray MsgpackView::get_data() const {
+    return data;
+}
+
+int64_t MsgpackView::get_offset() const {
+    return offset;
+}
+
+bool MsgpackView::is_array() const {
+    return token == Msgpack::TOKEN_ARRAY;
+}
+
+bool MsgpackView::is_map() const {
+    return token == Msgpack::TOKEN_MAP;
+}
+
+int64_t MsgpackView::size() {
+    return token == Msgpack::TOKEN_VALUE ? 0 : count;
+}
+
+Array MsgpackView::keys() {
+    Array res;
+    if (token != Msgpack::TOKEN_MAP || !_build_index()) {
+        return res;
+    }
+    res.resize(count);
+    for (int64_t i = 0; i < count; i++) {
+        res[i] = _decode(index[i * 2]);
+    }
+    return res;
+}
+
+Variant MsgpackView::get(const Variant& key) {
+    if (token == Msgpack::TOKEN_ARRAY && key.get_type() == Variant::INT) {
+        return get_index(key);
+    }
+    int64_t at = _find(key);
+    return at < 0 ? Variant() : _decode(at);
+}
+
+Variant MsgpackView::get_index(int64_t p_index) {
+    if (token != Msgpack::TOKEN_ARRAY || !_build_index()) {
+        return Variant();
+    }
+    if (p_index < 0) {
+        p_index += count;
+    }
+    ERR_FAIL_INDEX_V(p_index, count, Variant());
+    return _decode(index[p_index]);
+}
+
+Variant MsgpackView::get_path(const String& path) {
+    Ref<MsgpackView> view = get_view(path);
+    return view.is_valid() ? view->to_variant() : Variant();
+}
+
+Ref<MsgpackView> MsgpackView::get_view(const String& path) {
+    PackedStringArray segments = path.split("/", false);
+    if (segments.is_empty()) {
+        return Ref<MsgpackView>(this);
+    }
+
+    // The first step goes through the index of this view, deeper ones scan
+    // their container once.
+    int64_t at = -1;
+    if (token == Msgpack::TOKEN_ARRAY && segments[0].is_valid_int()) {
+        int64_t i = segments[0].to_int();
+        if (_build_index() && i >= 0 && i < count) {
+            at = index[i];
+        }
+    } else if (token == Msgpack::TOKEN_MAP) {
+        at = _find(segments[0]);
+        if (at < 0 && segments[0].is_valid_int()) {
+            at = _find(segments[0].to_int());
+        }
+    }
+    for (int64_t i = 1; i < segments.size() && at >= 0; i++) {
+        at = _find_child(at, segments[i]);
+    }
+    if (at < 0) {
+        return Ref<MsgpackView>();
+    }
+
+    Ref<MsgpackView> view;
+    view.instantiate();
+    view->_open(data, at);
+    return view;
+}
+
+Variant MsgpackView::to_variant() {
+    return _decode(offset);
+}
+
+Error MsgpackView::get_error() const {
+    return error.code;
+}
+
+int64_t MsgpackView::get_error_offset() const {
+    return error.offset;
+}
+
+String MsgpackView::get_error_message() const {
+    return error.message;
+}
+
+void MsgpackView::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("set_data", "data"), &MsgpackView::set_data);
+    ClassDB::bind_method(D_METHOD("get_data"), &MsgpackView::get_data);
+    ClassDB::bind_method(D_METHOD("get_offset"), &MsgpackView::get_offset);
+    ClassDB::bind_method(D_METHOD("is_array"), &MsgpackView::is_array);
+    ClassDB::bind_method(D_METHOD("is_map"), &MsgpackView::is_map);
+    ClassDB::bind_method(D_METHOD("size"), &MsgpackView::size);
+    ClassDB::bind_method(D_METHOD("keys"), &MsgpackView::keys);
+    ClassDB::bind_method(D_METHOD("get", "key"), &MsgpackView::get);
+    ClassDB::bind_method(D_METHOD("get_index", "index"), &MsgpackView::get_index);
+    ClassDB::bind_method(D_METHOD("get_path", "path"), &MsgpackView::get_path);
+    ClassDB::bind_method(D_METHOD("get_view", "path"), &MsgpackView::get_view);
+    ClassDB::bind_method(D_METHOD("to_variant"), &MsgpackView::to_variant);
+    ClassDB::bind_method(D_METHOD("get_error"), &MsgpackView::get_error);
+    ClassDB::bind_method(D_METHOD("get_error_offset"), &MsgpackView::get_error_offset);
+    ClassDB::bind_method(D_METHOD("get_error_message"), &MsgpackView::get_error_message);
+
+    ADD_PROPERTY(PropertyInfo(Variant::PACKED_BYTE_ARRAY, "data"), "set_data", "get_data");
+}
+
+void MsgpackView::_open(const PackedByteArray& p_data, int64_t p_offset) {
+    data = p_data;
+    offset = p_offset;
+    token = Msgpack::TOKEN_VALUE;
+    count = 0;
+    index.clear();
+    indexed = false;
+    error = MsgpackError();
+
+    // Only the header is read here, scalars are decoded again on access.
+    MsgpackReader reader(data.ptr() + offset, data.size() - offset);
+    Variant value;
+    token = Msgpack::_unpack_token(reader, value, count, error);
+    body = offset + reader.get_position();
+    if (error.failed()) {
+        error.offset += offset;
+        token = Msgpack::TOKEN_VALUE;
+    }
+}
+
+bool MsgpackView::_build_index() {
+    if (indexed) {
+        return !error.failed();
+    }
+    indexed = true;
+    if (error.failed()) {
+        return false;
+    }
+
+    int64_t elements = token == Msgpack::TOKEN_MAP ? count * 2 : count;
+    MsgpackReader reader(data.ptr() + body, data.size() - body);
+    // Every element takes at least one byte.
+    if (!reader.has(elements)) {
+        error.set(Error::ERR_FILE_EOF, offset, "Not enough buffer for container!");
+        return false;
+    }
+    index.resize(elements);
+    for (int64_t i = 0; i < elements; i++) {
+        index[i] = body + reader.get_position();
+        Msgpack::_skip(reader, error);
+        if (error.failed()) {
+            error.offset += body;
+            index.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+int64_t MsgpackView::_find(const Variant& key) {
+    if (token != Msgpack::TOKEN_MAP || !_build_index()) {
+        return -1;
+    }
+    CharString key_utf8;
+    if (key.get_type() == Variant::STRING || key.get_type() == Variant::STRING_NAME) {
+        key_utf8 = String(key).utf8();
+    }
+    const uint8_t *ptr = data.ptr();
+    for (int64_t i = 0; i < count; i++) {
+        int64_t at = index[i * 2];
+        MsgpackReader reader(ptr + at, index[i * 2 + 1] - at);
+        MsgpackError key_error;
+        if (_match_key(reader, key, key_utf8, key_error)) {
+            return index[i * 2 + 1];
+        }
+    }
+    return -1;
+}
+
+int64_t MsgpackView::_find_child(int64_t at, const String& segment) {
+    MsgpackReader reader(data.ptr() + at, data.size() - at);
+    MsgpackError scan_error;
+    Variant value;
+    int64_t size = 0;
+    Msgpack::Token child = Msgpack::_unpack_token(reader, value, size, scan_error);
+
+    if (child == Msgpack::TOKEN_ARRAY && segment.is_valid_int()) {
+        int64_t i = segment.to_int();
+        if (i < 0 || i >= size) {
+            return -1;
+        }
+        for (; i > 0 && !scan_error.failed(); i--) {
+            Msgpack::_skip(reader, scan_error);
+        }
+        return scan_error.failed() ? -1 : at + reader.get_position();
+    } else if (child != Msgpack::TOKEN_MAP) {
+        return -1;
+    }
+
+    Variant int_key = segment.is_valid_int() ? Variant(segment.to_int()) : Variant();
+    CharString key_utf8 = segment.utf8();
+    for (int64_t i = 0; i < size && !scan_error.failed(); i++) {
+        // Try the segment as a string key, then as an integer key.
+        int64_t key_start = reader.get_position();
+        bool found = _match_key(reader, segment, key_utf8, scan_error);
+        if (!found && !scan_error.failed() && int_key.get_type() == Variant::INT) {
+            MsgpackReader retry(data.ptr() + at + key_start, data.size() - at - key_start);
+            found = _match_key(retry, int_key, CharString(), scan_error);
+        }
+        if (scan_error.failed()) {
+            return -1;
+        }
+        if (found) {
+            return at + reader.get_position();
+        }
+        Msgpack::_skip(reader, scan_error);
+    }
+    return -1;
+}
+
+Variant MsgpackView::_decode(int64_t at) {
+    MsgpackReader reader(data.ptr() + at, data.size() - at);
+    MsgpackError decode_error;
+    Variant res = Msgpack::_unpack(reader, decode_error);
+    if (decode_error.failed()) {
+        error = decode_error;
+        error.offset += at;
+        Msgpack::_print_error(error);
+        return Variant();
+    }
+    return res;
+}
+
+bool MsgpackView::_match_key(MsgpackReader &reader, const Variant& key, const CharString& key_utf8, MsgpackError &key_error) {
+    if (key.get_type() != Variant::STRING && key.get_type() != Variant::STRING_NAME) {
+        Variant decoded = Msgpack::_unpack(reader, key_error);
+        return !key_error.failed() && decoded.get_type() == key.get_type() && decoded == key;
+    }
+
+    // String keys are compared on their raw bytes without decoding them.
+    const uint8_t *head = reader.peek();
+    int64_t header = 0;
+    int64_t length = 0;
+    if (!reader.has(1)) {
+        header = 0;
+    } else if ((head[0] & 0xE0) == MSGPACK_FORMAT_FIXSTR) {
+        header = 1;
+        length = head[0] & 0x1f;
+    } else if (head[0] == MSGPACK_FORMAT_STR_8 && reader.has(2)) {
+        header = 2;
+        length = head[1];
+    } else if (head[0] == MSGPACK_FORMAT_STR_16 && reader.has(3)) {
+        header = 3;
+        length = (int64_t(head[1]) << 8) | head[2];
+    } else if (head[0] == MSGPACK_FORMAT_STR_32 && reader.has(5)) {
+        header = 5;
+        length = (int64_t(head[1]) << 24) | (int64_t(head[2]) << 16) | (int64_t(head[3]) << 8) | head[4];
+    }
+    if (header == 0 || !reader.has(header + length)) {
+        Msgpack::_skip(reader, key_error);
+        return false;
+    }
+    const uint8_t *bytes = reader.get_data(header + length) + header;
+    return length == key_utf8.length() && memcmp(bytes, key_utf8.get_data(), length) == 0;
+}
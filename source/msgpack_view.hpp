@@ -0,0 +1,59 @@
+#ifndef MSGPACK_VIEW_HPP
+#define MSGPACK_VIEW_HPP
+
+#include "msgpack.hpp"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+namespace godot {
+    // Read-only view of one encoded value. Only the values that are asked for
+    // are decoded, the rest of the buffer is skipped over. Child views share
+    // the buffer of their parent.
+    class MsgpackView : public RefCounted {
+        GDCLASS(MsgpackView, RefCounted)
+
+    public:
+        void set_data(const PackedByteArray& p_data);
+        PackedByteArray get_data() const;
+        int64_t get_offset() const;
+
+        bool is_array() const;
+        bool is_map() const;
+        int64_t size();
+        Array keys();
+        Variant get(const Variant& key);
+        Variant get_index(int64_t index);
+        Variant get_path(const String& path);
+        Ref<MsgpackView> get_view(const String& path);
+        Variant to_variant();
+
+        Error get_error() const;
+        int64_t get_error_offset() const;
+        String get_error_message() const;
+
+    protected:
+        static void _bind_methods();
+
+    private:
+        PackedByteArray data;
+        int64_t offset = 0;
+        Msgpack::Token token = Msgpack::TOKEN_VALUE;
+        int64_t count = 0;
+        int64_t body = 0;
+        // Element offsets, built on first random access. Maps store key and
+        // value offsets interleaved.
+        LocalVector<int64_t> index;
+        bool indexed = false;
+        MsgpackError error;
+
+        void _open(const PackedByteArray& p_data, int64_t p_offset);
+        bool _build_index();
+        int64_t _find(const Variant& key);
+        int64_t _find_child(int64_t at, const String& segment);
+        Variant _decode(int64_t at);
+        static bool _match_key(MsgpackReader &reader, const Variant& key, const CharString& key_utf8, MsgpackError &key_error);
+    };
+}
+
+#endif //MSGPACK_VIEW_HPP
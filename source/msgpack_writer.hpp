@@ -0,0 +1,175 @@
+#ifndef MSGPACK_WRITER_HPP
+#define MSGPACK_WRITER_HPP
+
+#include <godot_cpp/core/defs.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+namespace godot {
+    // Growable big-endian byte buffer owned by the extension. Bytes are written
+    // straight into the storage of a PackedByteArray, so finishing hands the
+    // array back without copying it. If the storage cannot grow, is_failed()
+    // is set and nothing more is written until clear() or reset_to().
+    class MsgpackWriter {
+    public:
+        // Msgpack::PackFlags applied by the encoder.
+        uint32_t flags = 0;
+
+        explicit MsgpackWriter(int64_t p_capacity = 0) {
+            // Only a hint, failing to reserve it is not an error.
+            if (p_capacity > 0 && !_grow(p_capacity)) {
+                failed = false;
+            }
+        }
+
+        _FORCE_INLINE_ bool reserve(int64_t p_bytes) {
+            if (unlikely(size + p_bytes > capacity)) {
+                return _grow(size + p_bytes);
+            }
+            return true;
+        }
+
+        _FORCE_INLINE_ void put_u8(uint8_t p_value) {
+            if (unlikely(!reserve(1))) {
+                return;
+            }
+            data[size++] = p_value;
+        }
+
+        _FORCE_INLINE_ void put_u16(uint16_t p_value) {
+            if (unlikely(!reserve(2))) {
+                return;
+            }
+            data[size++] = uint8_t(p_value >> 8);
+            data[size++] = uint8_t(p_value);
+        }
+
+        _FORCE_INLINE_ void put_u32(uint32_t p_value) {
+            if (unlikely(!reserve(4))) {
+                return;
+            }
+            data[size++] = uint8_t(p_value >> 24);
+            data[size++] = uint8_t(p_value >> 16);
+            data[size++] = uint8_t(p_value >> 8);
+            data[size++] = uint8_t(p_value);
+        }
+
+        _FORCE_INLINE_ void put_u64(uint64_t p_value) {
+            put_u32(uint32_t(p_value >> 32));
+            put_u32(uint32_t(p_value));
+        }
+
+        _FORCE_INLINE_ void put_float(float p_value) {
+            uint32_t bits;
+            memcpy(&bits, &p_value, sizeof(bits));
+            put_u32(bits);
+        }
+
+        _FORCE_INLINE_ void put_double(double p_value) {
+            uint64_t bits;
+            memcpy(&bits, &p_value, sizeof(bits));
+            put_u64(bits);
+        }
+
+        _FORCE_INLINE_ void put_data(const uint8_t *p_data, int64_t p_size) {
+            if (p_size <= 0) {
+                return;
+            }
+            if (unlikely(!reserve(p_size))) {
+                return;
+            }
+            memcpy(data + size, p_data, p_size);
+            size += p_size;
+        }
+
+        // Reserves p_size bytes and returns where to write them, nullptr if
+        // that failed.
+        _FORCE_INLINE_ uint8_t *put_space(int64_t p_size) {
+            if (unlikely(!reserve(p_size))) {
+                return nullptr;
+            }
+            uint8_t *p = data + size;
+            size += p_size;
+            return p;
+        }
+
+        _FORCE_INLINE_ int64_t get_size() const {
+            return size;
+        }
+
+        // Bytes already written, for patching headers in place.
+        _FORCE_INLINE_ uint8_t *get_data_at(int64_t p_offset) {
+            return data + p_offset;
+        }
+
+        // Drops everything written after the first p_size bytes.
+        _FORCE_INLINE_ void truncate(int64_t p_size) {
+            if (p_size < size) {
+                size = p_size;
+            }
+        }
+
+        // Like truncate(), but also forgets a failed allocation, for callers
+        // dropping everything written since before it.
+        _FORCE_INLINE_ void reset_to(int64_t p_size) {
+            truncate(p_size);
+            failed = false;
+        }
+
+        _FORCE_INLINE_ bool is_failed() const {
+            return failed;
+        }
+
+        // Copy of the written bytes, the writer keeps its storage.
+        PackedByteArray get_bytes() const {
+            return buffer.slice(0, size);
+        }
+
+        // Forgets the written bytes but keeps the capacity.
+        _FORCE_INLINE_ void clear() {
+            size = 0;
+            failed = false;
+        }
+
+        // Trims the storage to the written size and returns it. The writer is
+        // empty afterwards.
+        PackedByteArray finish() {
+            buffer.resize(size);
+            PackedByteArray result = buffer;
+            buffer = PackedByteArray();
+            data = nullptr;
+            size = 0;
+            capacity = 0;
+            failed = false;
+            return result;
+        }
+
+    private:
+        bool _grow(int64_t p_min_capacity) {
+            if (failed) {
+                return false;
+            }
+            int64_t new_capacity = capacity < 64 ? 64 : capacity;
+            while (new_capacity < p_min_capacity && new_capacity < (INT64_MAX >> 1)) {
+                new_capacity <<= 1;
+            }
+            if (new_capacity < p_min_capacity || buffer.resize(new_capacity) != OK) {
+                failed = true;
+                return false;
+            }
+            data = buffer.ptrw();
+            capacity = new_capacity;
+            return true;
+        }
+
+        PackedByteArray buffer;
+        uint8_t *data = nullptr;
+        int64_t size = 0;
+        int64_t capacity = 0;
+        bool failed = false;
+    };
+}
+
+#endif //MSGPACK_WRITER_HPP
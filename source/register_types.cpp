@@ -7,20 +7,46 @@
 #include <godot_cpp/classes/engine.hpp>
 
 #include "msgpack.hpp"
+#include "msgpack_encoder.hpp"
+#include "msgpack_file.hpp"
+#include "msgpack_packet_peer.hpp"
+#include "msgpack_schema.hpp"
+#include "msgpack_stream_decoder.hpp"
+#include "msgpack_view.hpp"
 
 using namespace godot;
 
 static Msgpack *msgpack;
 
+#ifdef MSGPACK_BINDING_FUZZ
+void msgpack_binding_fuzz_main();
+#endif
+#ifdef MSGPACK_BINDING_TESTS
+void msgpack_binding_tests_main();
+#endif
+
 void initialize_msgpack(ModuleInitializationLevel p_level) {
     if (p_level != MODULE_INITIALIZATION_LEVEL_SCENE) {
         return;
     }
 
     ClassDB::register_class<Msgpack>();
+    ClassDB::register_class<MsgpackEncoder>();
+    ClassDB::register_class<MsgpackFile>();
+    ClassDB::register_class<MsgpackPacketPeer>();
+    ClassDB::register_class<MsgpackSchema>();
+    ClassDB::register_class<MsgpackStreamDecoder>();
+    ClassDB::register_class<MsgpackView>();
 
     msgpack = memnew(Msgpack);
     Engine::get_singleton()->register_singleton("Msgpack", Msgpack::get_singleton());
+
+#ifdef MSGPACK_BINDING_FUZZ
+    msgpack_binding_fuzz_main();
+#endif
+#ifdef MSGPACK_BINDING_TESTS
+    msgpack_binding_tests_main();
+#endif
 }
 
 void uninitialize_msgpack(ModuleInitializationLevel p_level) {
@@ -0,0 +1,52 @@
+// Regression tests for the Msgpack binding.
+//
+// Variants need a running engine, so like the binding fuzz harness these
+// are linked into the extension. `scons test godot=<path to Godot>` builds
+// the extension with them, copies it into tests/project and runs Godot
+// headless on that project with `-- --msgpack-test`. Godot exits with a
+// non-zero status when a test fails, which fails the build.
+
+#include "msgpack.hpp"
+
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <cstdlib>
+
+using namespace godot;
+
+static int64_t failures = 0;
+
+static void _check(bool condition, const char *name) {
+    if (!condition) {
+        UtilityFunctions::printerr(String("FAILED: ") + name);
+        failures++;
+    }
+}
+
+// Patches above compression_threshold have to stay readable, PACK_COMPRESS
+// used to wrap them in a frame apply_delta did not accept.
+static void _test_delta_ignores_compress() {
+    Msgpack *msgpack = Msgpack::get_singleton();
+    Dictionary previous;
+    previous["name"] = "a";
+    previous["count"] = 1;
+    Dictionary current = previous.duplicate();
+    current["name"] = String("b").repeat(4096);
+
+    PackedByteArray patch = msgpack->pack_delta(previous, current, Msgpack::PACK_COMPRESS);
+    _check(patch.size() > 1024, "delta patch above the compression threshold");
+    _check(msgpack->apply_delta(previous, patch) == Variant(current), "compressed delta round trip");
+}
+
+// Called once the extension is initialized, runs the tests and exits when
+// the command line asks for it.
+void msgpack_binding_tests_main() {
+    PackedStringArray args = OS::get_singleton()->get_cmdline_user_args();
+    if (args.is_empty() || args[0] != "--msgpack-test") {
+        return;
+    }
+    _test_delta_ignores_compress();
+    UtilityFunctions::print(failures == 0 ? String("All tests passed.") : String("Tests failed."));
+    exit(failures == 0 ? 0 : 1);
+}